@@ -0,0 +1,276 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * ByteSource - Composable pull-based byte stream stages
+ */
+
+#ifndef BYTE_SOURCE_H
+#define BYTE_SOURCE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <sys/types.h>
+#include <zlib.h>
+#include "FirmwareInfo.h"
+#include "PageCache.h"
+
+namespace Odin {
+
+constexpr uint64_t BYTE_SOURCE_UNKNOWN_SIZE = ~static_cast<uint64_t>(0);
+
+// How file stages get their bytes
+enum class ReadMode {
+    Buffered = 0,   // pread through the page cache
+    Mmap = 1,       // memory-mapped file
+    Uring = 2,      // io_uring with several reads in flight (Linux)
+    Direct = 3      // O_DIRECT, bypassing the page cache
+};
+
+// One stage of a read pipeline. Stages own the stage below them, so a
+// payload nested as zip -> tar.md5 -> lz4 is read by stacking a file,
+// ZIP member, TAR entry and LZ4 frame stage. Every stage keeps at most
+// one fixed-size buffer; nothing is written to disk.
+class ByteSource {
+public:
+    static const std::string TAG;
+    
+    virtual ~ByteSource() = default;
+    
+    // Read up to size bytes. Returns the count (0 at the end), -1 on error.
+    virtual ssize_t read(char* buffer, size_t size) = 0;
+    
+    // Total bytes this stage yields, BYTE_SOURCE_UNKNOWN_SIZE if it
+    // cannot tell without decoding everything
+    virtual uint64_t size() const = 0;
+    
+    // Bytes yielded so far
+    virtual uint64_t position() const = 0;
+    
+    // Advance without returning data. Seekable stages override this;
+    // the default decodes and discards.
+    virtual bool skip(uint64_t bytes);
+    
+    // Hint that the next bytes will be read soon
+    virtual void readahead(uint64_t bytes) { (void)bytes; }
+    
+    // Large buffers held by this stage and the ones below it. Callers
+    // that charge the memory budget add this to their own request, so a
+    // transfer takes one lease instead of holding one while waiting for
+    // another.
+    virtual size_t bufferBytes() const { return 0; }
+    
+    // Read exactly size bytes
+    bool readFully(char* buffer, size_t size);
+    
+    // Read up to size bytes, short only at the end. Returns -1 on error.
+    ssize_t readUpTo(char* buffer, size_t size);
+    
+    // File stage over [offset, offset + length) of path. Reads are
+    // reported to cache, if given, for page cache advice.
+    static std::unique_ptr<ByteSource> openFile(const std::string& path, ReadMode mode,
+                                                uint64_t offset = 0,
+                                                uint64_t length = BYTE_SOURCE_UNKNOWN_SIZE,
+                                                PageCache::Reader* cache = nullptr);
+    
+    // Sequential stage over a pipe or terminal (not closed on destruction)
+    static std::unique_ptr<ByteSource> openStream(int fd);
+};
+
+// pread-based file stage
+class FileSource : public ByteSource {
+public:
+    FileSource(int fd, uint64_t offset, uint64_t length);
+    ~FileSource() override;
+    
+    ssize_t read(char* buffer, size_t size) override;
+    uint64_t size() const override { return length_; }
+    uint64_t position() const override { return position_; }
+    bool skip(uint64_t bytes) override;
+    void readahead(uint64_t bytes) override;
+    
+    void setCache(PageCache::Reader* cache) { cache_ = cache; }
+
+private:
+    int fd_;
+    uint64_t offset_;
+    uint64_t length_;
+    uint64_t position_;
+    PageCache::Reader* cache_;
+};
+
+// read(2)-based stage for descriptors that cannot seek, e.g. stdin.
+// Size is unknown and skipping reads and discards.
+class StreamSource : public ByteSource {
+public:
+    explicit StreamSource(int fd) : fd_(fd), position_(0) {}
+    
+    ssize_t read(char* buffer, size_t size) override;
+    uint64_t size() const override { return BYTE_SOURCE_UNKNOWN_SIZE; }
+    uint64_t position() const override { return position_; }
+
+private:
+    int fd_;
+    uint64_t position_;
+};
+
+// Memory-mapped file stage, reads are plain copies out of the mapping
+class MmapSource : public ByteSource {
+public:
+    MmapSource(int fd, uint64_t offset, uint64_t length);
+    ~MmapSource() override;
+    
+    bool isValid() const { return base_ != nullptr; }
+    
+    ssize_t read(char* buffer, size_t size) override;
+    uint64_t size() const override { return length_; }
+    uint64_t position() const override { return position_; }
+    bool skip(uint64_t bytes) override;
+    void readahead(uint64_t bytes) override;
+    
+    void setCache(PageCache::Reader* cache) { cache_ = cache; }
+
+private:
+    char* base_;            // Start of the mapping (page aligned)
+    size_t mapLength_;
+    size_t delta_;          // offset - page aligned offset
+    uint64_t offset_;
+    uint64_t length_;
+    uint64_t position_;
+    PageCache::Reader* cache_;
+    size_t released_;       // Mapping bytes already unmapped behind the reader
+};
+
+// Non-owning view of a stage owned elsewhere, for stacking windows on a
+// stream that outlives them (a decoded container read entry by entry)
+class BorrowedSource : public ByteSource {
+public:
+    explicit BorrowedSource(ByteSource& upstream) : upstream_(upstream) {}
+    
+    ssize_t read(char* buffer, size_t size) override { return upstream_.read(buffer, size); }
+    uint64_t size() const override { return upstream_.size(); }
+    uint64_t position() const override { return upstream_.position(); }
+    bool skip(uint64_t bytes) override { return upstream_.skip(bytes); }
+    void readahead(uint64_t bytes) override { upstream_.readahead(bytes); }
+    size_t bufferBytes() const override { return upstream_.bufferBytes(); }
+
+private:
+    ByteSource& upstream_;
+};
+
+// Yields bytes already taken from a stream (a format probe), then the
+// rest of the stream
+class ReplaySource : public ByteSource {
+public:
+    ReplaySource(const char* head, size_t headSize, std::unique_ptr<ByteSource> rest);
+    
+    ssize_t read(char* buffer, size_t size) override;
+    uint64_t size() const override;
+    uint64_t position() const override { return position_; }
+    void readahead(uint64_t bytes) override { rest_->readahead(bytes); }
+    size_t bufferBytes() const override { return rest_->bufferBytes(); }
+
+private:
+    std::string head_;
+    std::unique_ptr<ByteSource> rest_;
+    uint64_t position_;
+};
+
+// zlib inflate stage. windowBits selects the framing: -15 raw deflate
+// (ZIP), 15 + 32 zlib/gzip auto-detect.
+class InflateSource : public ByteSource {
+public:
+    InflateSource(std::unique_ptr<ByteSource> upstream, int windowBits,
+                  uint64_t outputSize = BYTE_SOURCE_UNKNOWN_SIZE);
+    ~InflateSource() override;
+    
+    bool isValid() const { return initialized_; }
+    
+    ssize_t read(char* buffer, size_t size) override;
+    uint64_t size() const override { return outputSize_; }
+    uint64_t position() const override { return position_; }
+    void readahead(uint64_t bytes) override { upstream_->readahead(bytes); }
+    size_t bufferBytes() const override { return input_.size() + upstream_->bufferBytes(); }
+
+private:
+    std::unique_ptr<ByteSource> upstream_;
+    z_stream stream_;
+    bool initialized_;
+    bool finished_;
+    uint64_t outputSize_;
+    uint64_t position_;
+    std::vector<unsigned char> input_;
+};
+
+// gzip stage (.gz, .tar.gz)
+class GzipSource : public InflateSource {
+public:
+    explicit GzipSource(std::unique_ptr<ByteSource> upstream);
+};
+
+// Window of [offset, offset + length) into the upstream, e.g. one TAR entry
+class TarEntrySource : public ByteSource {
+public:
+    TarEntrySource(std::unique_ptr<ByteSource> upstream, uint64_t offset, uint64_t length);
+    
+    // Positions the upstream at the entry start
+    bool open();
+    
+    ssize_t read(char* buffer, size_t size) override;
+    uint64_t size() const override { return length_; }
+    uint64_t position() const override { return position_; }
+    bool skip(uint64_t bytes) override;
+    void readahead(uint64_t bytes) override;
+    size_t bufferBytes() const override { return upstream_->bufferBytes(); }
+
+private:
+    std::unique_ptr<ByteSource> upstream_;
+    uint64_t offset_;
+    uint64_t length_;
+    uint64_t position_;
+};
+
+// Pass-through over one or more LZ4 frames. The frame and block headers
+// are checked as they stream past, so a damaged image is rejected before
+// its tail is sent; the data itself is not decompressed.
+class Lz4FrameSource : public ByteSource {
+public:
+    explicit Lz4FrameSource(std::unique_ptr<ByteSource> upstream);
+    
+    ssize_t read(char* buffer, size_t size) override;
+    uint64_t size() const override { return upstream_->size(); }
+    uint64_t position() const override { return upstream_->position(); }
+    void readahead(uint64_t bytes) override { upstream_->readahead(bytes); }
+    size_t bufferBytes() const override { return upstream_->bufferBytes(); }
+    
+    // Completed frames so far
+    uint64_t getFrameCount() const { return frames_; }
+
+private:
+    enum class State { Magic, Header, BlockSize, BlockData, ContentChecksum, SkippableSize, SkippableData };
+    
+    bool consume(const unsigned char* data, size_t size);
+    bool completeField();
+    
+    std::unique_ptr<ByteSource> upstream_;
+    State state_;
+    bool failed_;
+    unsigned char field_[20];   // Partially received header field
+    size_t fieldFill_;
+    size_t fieldNeed_;
+    uint64_t remaining_;        // Bytes left in the current block or skippable frame
+    bool blockChecksum_;
+    bool contentChecksum_;
+    uint32_t maxBlockSize_;
+    uint64_t frames_;
+};
+
+// Rebuild the stage stack recorded for a payload (see SourceStage). The
+// result yields the innermost container's bytes, starting at 0.
+std::unique_ptr<ByteSource> openSourceChain(const std::string& path,
+                                            const std::vector<SourceStage>& stages,
+                                            ReadMode mode, PageCache::Reader* cache = nullptr);
+
+} // namespace Odin
+
+#endif // BYTE_SOURCE_H
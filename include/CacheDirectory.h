@@ -0,0 +1,32 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * CacheDirectory - Per-user directories of the persistent caches
+ */
+
+#ifndef CACHE_DIRECTORY_H
+#define CACHE_DIRECTORY_H
+
+#include <string>
+#include <string_view>
+
+namespace Odin {
+
+// $XDG_CACHE_HOME/odin4/<name>, else ~/.cache/odin4/<name>. Empty when
+// neither variable is set: there is no shared fallback such as /tmp,
+// where another user could plant entries, so the cache is then off.
+std::string cacheDirectory(const std::string& name);
+
+// Whether directory exists, is owned by this user and is closed to
+// everyone else (mode 0700). With create, missing components are made
+// first (mkdir -p). Cache files are only read or written after this
+// succeeds; an empty directory never does.
+bool privateCacheDirectory(const std::string& directory, bool create);
+
+// directory/<16 hex digits of FNV-1a over key><suffix>. The key itself
+// is stored in the file and compared on load, so collisions only cost
+// a miss.
+std::string cacheFilePath(const std::string& directory, std::string_view key, const char* suffix);
+
+} // namespace Odin
+
+#endif // CACHE_DIRECTORY_H
@@ -0,0 +1,99 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * ChunkManifest - Chunked SHA-256 digests of archive entries
+ */
+
+#ifndef CHUNK_MANIFEST_H
+#define CHUNK_MANIFEST_H
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <future>
+#include <cstdint>
+#include "Digest.h"
+
+namespace Odin {
+
+// Chunk size of new chunk manifests
+constexpr uint64_t CHUNK_MANIFEST_CHUNK_SIZE = 0x400000;   // 4MB
+
+// Chunk sizes accepted from a chunk manifest. A transfer holds two
+// halves of whole chunks in memory, so a chunk is at most half of the
+// 16MB transfer window.
+constexpr uint64_t CHUNK_MANIFEST_MIN_CHUNK = 0x10000;     // 64KB
+constexpr uint64_t CHUNK_MANIFEST_MAX_CHUNK = 0x800000;    // 8MB
+
+// One file or TAR entry in a ChunkManifest: the SHA-256 of every
+// chunkSize bytes (the last chunk may be shorter) and the Merkle root
+// over them, which stands for the whole entry
+struct ChunkedEntry {
+    std::string name;
+    uint64_t size;
+    uint64_t chunkSize;
+    std::vector<Digest> chunks;
+    Digest root;
+    
+    ChunkedEntry() : size(0), chunkSize(CHUNK_MANIFEST_CHUNK_SIZE) {}
+    
+    uint64_t chunkOffset(size_t index) const { return static_cast<uint64_t>(index) * chunkSize; }
+    uint64_t chunkLength(size_t index) const { return std::min(chunkSize, size - chunkOffset(index)); }
+};
+
+// Manifest of chunked digests, kept next to an archive. Unlike one MD5
+// over the whole archive, chunks are checked independently: on all
+// cores at once, one at a time as a transfer passes them, and a
+// mismatch names the byte range that is bad.
+//
+// Text format:
+//   odin4-chunks 1 <chunk size>
+//   <root> <size> <name>       per entry, followed by
+//   <chunk digest>             one line per chunk
+class ChunkManifest {
+public:
+    static const std::string TAG;
+    
+    explicit ChunkManifest(uint64_t chunkSize = CHUNK_MANIFEST_CHUNK_SIZE);
+    
+    // path + ".chunks"
+    static std::string sidecarPath(const std::string& path);
+    
+    // Fails on any malformed line or an entry whose chunks do not add up
+    // to its root
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+    
+    // Describe size bytes at offset in path as entry name; the chunks are
+    // hashed concurrently on the HashService
+    bool add(const std::string& name, const std::string& path, uint64_t offset, uint64_t size);
+    
+    std::shared_ptr<const ChunkedEntry> find(const std::string& name) const;
+    size_t getEntryCount() const { return entries_.size(); }
+    
+    // Queue the chunks of an entry stored at offset in path on the
+    // HashService, then compare the results. Indexes of chunks that do
+    // not match (or could not be read) are appended to badChunks.
+    static std::vector<std::shared_future<std::string>> submitVerify(const ChunkedEntry& entry,
+                                                                     const std::string& path, uint64_t offset);
+    static bool checkVerify(const ChunkedEntry& entry, const std::vector<std::shared_future<std::string>>& digests,
+                            std::vector<size_t>* badChunks = nullptr);
+    
+    // Both of the above
+    static bool verify(const ChunkedEntry& entry, const std::string& path, uint64_t offset,
+                       std::vector<size_t>* badChunks = nullptr);
+    
+    // Root over chunk digests: each parent is SHA-256(0x01 || left || right),
+    // an unpaired node moves up unchanged
+    static Digest merkleRoot(const std::vector<Digest>& leaves);
+
+private:
+    uint64_t chunkSize_;
+    std::vector<std::shared_ptr<const ChunkedEntry>> entries_;
+    std::unordered_map<std::string, size_t> byName_;
+};
+
+} // namespace Odin
+
+#endif // CHUNK_MANIFEST_H
@@ -0,0 +1,81 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * DeviceProfile - What a device in download mode reports it can do
+ */
+
+#ifndef DEVICE_PROFILE_H
+#define DEVICE_PROFILE_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "PIT.h"
+
+namespace Odin {
+
+// Items of the device info block (0x69) that the engine reads; others
+// are skipped. The block is DEVINFO_MAGIC, an item count, then one
+// {type, offset, size} record per item, offsets being from the start of
+// the block. Strings are not terminated, numbers are 32-bit little endian.
+// This layout and the item numbers are an assumption, not a documented
+// format, so the items are only logged and written to the run report;
+// no transfer setting is taken from them.
+enum class DeviceInfoItem : uint32_t {
+    Model = 0,
+    Serial = 1,
+    Region = 2,
+    Carrier = 3,
+    MaxPacketSize = 4,          // Largest SetPacketSize value accepted
+    CompressedDownload = 5,     // Nonzero if LZ4 payloads are decompressed on the device
+    MaxSequenceSize = 6,        // Largest size one FileSubCmd::SetInfo may announce
+    StorageType = 7,            // PITDeviceType of the main storage
+    ZeroLengthPackets = 8       // Nonzero if transfers may end in a ZLP
+};
+
+// What one device says about itself: the session result, the SystemLSI
+// and ZLP guesses from the USB descriptors, and the device info block
+// where it has one. Descriptive only; the engine negotiates the session
+// with the protocol defaults whatever the block contains.
+struct DeviceProfile {
+    static const std::string TAG;
+    
+    std::string product;        // USB product string
+    std::string model;
+    std::string serial;
+    std::string region;
+    std::string carrier;
+    
+    int protocolVersion;        // Session begin result; 0 cannot change packet size
+    bool systemLSI;
+    bool zeroLengthPackets;
+    bool compressedDownload;
+    bool compressedReported;
+    uint32_t maxPacketSize;     // 0 if not reported
+    uint64_t maxSequenceSize;   // 0 if not reported
+    PITDeviceType storage;
+    bool storageReported;
+    bool fromDeviceInfo;        // A device info block was parsed
+    
+    DeviceProfile()
+        : protocolVersion(0)
+        , systemLSI(false)
+        , zeroLengthPackets(false)
+        , compressedDownload(false)
+        , compressedReported(false)
+        , maxPacketSize(0)
+        , maxSequenceSize(0)
+        , storage(PITDeviceType::MMC)
+        , storageReported(false)
+        , fromDeviceInfo(false)
+    {}
+    
+    // Fill in the items present in a device info block; false if it is
+    // malformed, leaving the profile unchanged
+    bool parseDeviceInfo(const char* data, size_t size);
+    
+    void print() const;
+};
+
+} // namespace Odin
+
+#endif // DEVICE_PROFILE_H
@@ -0,0 +1,135 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * Digest - Fixed-size binary hash values
+ */
+
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace Odin {
+
+// An MD5 (16 bytes) or SHA-256 (32 bytes) value, held inline and compared
+// as bytes. Hex is only produced for logs and files.
+class Digest {
+public:
+    static constexpr size_t MAX_SIZE = 32;
+    
+    constexpr Digest() : bytes_{}, size_(0) {}
+    
+    constexpr Digest(const unsigned char* bytes, size_t size) : bytes_{}, size_(0) {
+        if (size <= MAX_SIZE) {
+            for (size_t i = 0; i < size; i++) {
+                bytes_[i] = bytes[i];
+            }
+            size_ = static_cast<uint8_t>(size);
+        }
+    }
+    
+    // 32 or 64 hex digits of either case; anything else gives an empty Digest
+    static constexpr Digest fromHex(std::string_view hex) {
+        Digest digest;
+        if (hex.size() != 32 && hex.size() != 64) {
+            return digest;
+        }
+        for (size_t i = 0; i < hex.size() / 2; i++) {
+            int high = hexValue(hex[2 * i]);
+            int low = hexValue(hex[2 * i + 1]);
+            if (high < 0 || low < 0) {
+                return Digest();
+            }
+            digest.bytes_[i] = static_cast<unsigned char>((high << 4) | low);
+        }
+        digest.size_ = static_cast<uint8_t>(hex.size() / 2);
+        return digest;
+    }
+    
+    constexpr bool empty() const { return size_ == 0; }
+    constexpr size_t size() const { return size_; }
+    constexpr const unsigned char* data() const { return bytes_; }
+    
+    // Lowercase hex, 2 * size() characters, not terminated
+    constexpr void toHex(char* out) const {
+        for (size_t i = 0; i < size_; i++) {
+            out[2 * i] = HEX_DIGITS[bytes_[i] >> 4];
+            out[2 * i + 1] = HEX_DIGITS[bytes_[i] & 0x0F];
+        }
+    }
+    
+    std::string hex() const {
+        std::string text(2 * size_, '0');
+        toHex(&text[0]);
+        return text;
+    }
+    
+    constexpr bool operator==(const Digest& other) const {
+        if (size_ != other.size_) {
+            return false;
+        }
+        for (size_t i = 0; i < size_; i++) {
+            if (bytes_[i] != other.bytes_[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    constexpr bool operator!=(const Digest& other) const { return !(*this == other); }
+
+private:
+    static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    
+    static constexpr int hexValue(char c) {
+        return c >= '0' && c <= '9' ? c - '0' :
+               c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+               c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    }
+    
+    unsigned char bytes_[MAX_SIZE];
+    uint8_t size_;
+};
+
+// FNV-1a, for hash tables keyed by name and for cache file names
+uint64_t fnv1a(std::string_view data);
+
+// Filename to Digest map with open addressing: one flat array of slots,
+// linear probing, kept at most half full. Built once per manifest and
+// then only looked up, thousands of times per device.
+class DigestMap {
+public:
+    DigestMap();
+    
+    // Replaces the digest of a name already present
+    void insert(const std::string& name, const Digest& digest);
+    
+    // nullptr if the name is not present
+    const Digest* find(std::string_view name) const;
+    
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    void clear();
+
+private:
+    struct Slot {
+        std::string name;
+        Digest digest;
+        uint64_t hash;
+        bool used;
+        
+        Slot() : hash(0), used(false) {}
+    };
+    
+    size_t probe(std::string_view name, uint64_t hash) const;
+    void grow();
+    
+    std::vector<Slot> slots_;   // Size is a power of two
+    size_t count_;
+};
+
+} // namespace Odin
+
+#endif // DIGEST_H
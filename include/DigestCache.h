@@ -0,0 +1,56 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * DigestCache - Remembered whole-file digests of firmware archives
+ */
+
+#ifndef DIGEST_CACHE_H
+#define DIGEST_CACHE_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include "Manifest.h"
+#include "IndexCache.h"
+
+namespace Odin {
+
+// Digests of whole files, kept with the file itself in user.odin4.*
+// extended attributes, or in a per-user store where the file system or
+// the file's permissions do not allow them. Each digest is stored with
+// the file's inode, size and mtime and is only returned while all three
+// still match. (ctime cannot be part of the key: writing the attribute
+// changes it.)
+class DigestCache {
+public:
+    static const std::string TAG;
+    
+    static DigestCache& instance();
+    
+    void setEnabled(bool enable) { enabled_ = enable; }
+    bool isEnabled() const { return enabled_; }
+    
+    // Lowercase hex digest recorded for the file with this identity
+    bool lookup(const FileIdentity& identity, HashAlgorithm algorithm, std::string& digest) const;
+    
+    // Record a digest of a file that kept this identity while it was
+    // hashed; take it before hashing and compare it afterwards
+    void store(const FileIdentity& identity, HashAlgorithm algorithm, const std::string& digest) const;
+    
+    // $XDG_CACHE_HOME/odin4/digests or ~/.cache/odin4/digests; empty,
+    // and the store off, if neither is set
+    static std::string defaultDirectory();
+
+private:
+    DigestCache();
+    
+    std::string storePath(const std::string& canonicalPath) const;
+    bool lookupStore(const FileIdentity& identity, HashAlgorithm algorithm, std::string& digest) const;
+    bool writeStore(const FileIdentity& identity, HashAlgorithm algorithm, const std::string& digest) const;
+    
+    std::string directory_;
+    std::atomic<bool> enabled_;
+};
+
+} // namespace Odin
+
+#endif // DIGEST_CACHE_H
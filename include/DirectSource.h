@@ -0,0 +1,57 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * DirectSource - File stage that bypasses the page cache
+ */
+
+#ifndef DIRECT_SOURCE_H
+#define DIRECT_SOURCE_H
+
+#include <memory>
+#include <cstdint>
+#include "ByteSource.h"
+
+namespace Odin {
+
+// File stage reading with O_DIRECT (F_NOCACHE on macOS), so firmware
+// never enters the page cache and the kernel does not copy it there
+// first. Direct reads must start, end and land on block boundaries: the
+// stage reads aligned blocks into a buffer from a process-wide pool and
+// hands out the requested range, so entries starting or ending mid-block
+// need nothing from the caller. Reads of whole aligned blocks into an
+// aligned caller buffer skip the pool buffer entirely.
+//
+// open() returns nullptr where the file system refuses direct I/O
+// (tmpfs, some FUSE mounts), and the caller falls back to buffered reads.
+class DirectSource : public ByteSource {
+public:
+    static const std::string TAG;
+    
+    // Takes ownership of fd on success
+    static std::unique_ptr<DirectSource> open(int fd, uint64_t offset, uint64_t length);
+    
+    ~DirectSource() override;
+    
+    ssize_t read(char* buffer, size_t size) override;
+    uint64_t size() const override { return length_; }
+    uint64_t position() const override { return position_; }
+    bool skip(uint64_t bytes) override;
+    size_t bufferBytes() const override;
+
+private:
+    DirectSource(int fd, uint64_t offset, uint64_t length);
+    
+    // Read the aligned block range holding the current position
+    bool fill();
+    
+    int fd_;
+    uint64_t offset_;
+    uint64_t length_;
+    uint64_t position_;
+    char* buffer_;              // Pooled, aligned
+    uint64_t bufferStart_;      // File offset of buffer_[0]
+    size_t bufferFill_;         // Valid bytes in buffer_
+};
+
+} // namespace Odin
+
+#endif // DIRECT_SOURCE_H
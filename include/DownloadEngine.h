@@ -8,12 +8,19 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 #include "UsbDevice.h"
-#include "FirmwareData.h"
+#include "FirmwareImage.h"
 #include "FirmwareInfo.h"
+#include "PIT.h"
+#include "PitCache.h"
+#include "FlashPlan.h"
+#include "DeviceProfile.h"
 
 namespace Odin {
 
+class AsyncSha256;
+
 // Protocol command codes (from decompiled code)
 enum class ProtocolCmd : int {
     SessionControl = 0x64,   // Session management
@@ -65,11 +72,23 @@ enum class WriteProtectionFail : int {
     Ext4 = -7
 };
 
+// One payload as sent, for the run report
+struct TransferRecord {
+    std::string filename;
+    uint64_t bytes;
+    std::string sha256;         // Of the buffers written to USB
+    std::string expected;       // Recorded digest, empty if none
+    double seconds;
+    bool completed;             // FileSubCmd::End acknowledged
+    
+    TransferRecord() : bytes(0), seconds(0), completed(false) {}
+};
+
 class DownloadEngine {
 public:
     static const std::string TAG;
     
-    DownloadEngine(const std::string& devicePath, FirmwareData* firmware);
+    DownloadEngine(const std::string& devicePath, std::shared_ptr<const FirmwareImage> firmware);
     ~DownloadEngine();
     
     // Non-copyable
@@ -92,10 +111,25 @@ public:
     bool sendPitInfo();
     bool receivePitInfo();
     
-    // File transfer
-    bool transmitData(const std::shared_ptr<char[]>& data, const FirmwareInfo& info);
-    bool transmitCompressedData(const std::shared_ptr<char[]>& data, const FirmwareInfo& info);
+    // Partition mapping (supplied PIT if any, else the device PIT)
+    bool mapPartitions();
+    
+    // Size and target checks of the mapped files, before anything is sent
+    bool planTransfers();
     
+    // File transfer (payloads are streamed from the image in bounded windows)
+    bool transmitData(const FirmwareInfo& info);
+    bool transmitCompressedData(const FirmwareInfo& info);
+    bool transmitPayload(const FirmwareInfo& info, ByteSource& source);
+    bool transmitStream();        // TAR piped on standard input
+    
+    // What the device reported (or was inferred) about itself, for the
+    // log and the run report
+    const DeviceProfile& getProfile() const { return profile_; }
+    
+    // Payloads sent so far, including one that failed its digest check
+    const std::vector<TransferRecord>& getTransfers() const { return transfers_; }
+
 private:
     // Protocol helpers
     bool request(int cmd, int subcmd, int arg = 0);
@@ -107,16 +141,27 @@ private:
     bool sendPitData(const char* data, int size);
     
     // Response handling
-    bool deviceInfoAnalysis(char* data);
+    bool deviceInfoAnalysis(const char* data, size_t size);
     void writeProtectionFail(int code);
     
+    // The supplied PIT if any, else the device PIT (empty if none was read)
+    const PIT& partitionTable() const;
+    
     // Member variables
     std::unique_ptr<UsbDevice> device_;
-    FirmwareData* firmware_;
+    std::shared_ptr<const FirmwareImage> firmware_;  // Shared, read-only
     std::string devicePath_;
     
+    // Per-device state
     int packetSize_;
     bool hasDeviceInfo_;
+    DeviceProfile profile_;
+    std::shared_ptr<const CachedPit> devicePit_;  // Shared with devices reporting the same PIT
+    std::vector<PITView::Entry> targets_;  // Indexed like firmware_->getFiles()
+    FlashPlan plan_;
+    std::unique_ptr<PayloadCursor> cursor_;
+    std::unique_ptr<AsyncSha256> sentDigest_;   // Hashes sent data on a helper thread
+    std::vector<TransferRecord> transfers_;
 };
 
 } // namespace Odin
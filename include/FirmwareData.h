@@ -9,7 +9,15 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <future>
+#include "ByteSource.h"
+#include "ChunkManifest.h"
 #include "FirmwareInfo.h"
+#include "FirmwareImage.h"
+#include "IndexCache.h"
+#include "Manifest.h"
+#include "PIT.h"
+#include "Zip.h"
 
 namespace Odin {
 
@@ -33,10 +41,23 @@ public:
     // Option setters
     void setErase(bool enable);
     void setOptionLock(bool enable);
+    void setIndexCache(bool enable);
+    void setReadMode(ReadMode mode) { readMode_ = mode; }
+    void setTarIndexWrite(bool enable) { tarIndexWrite_ = enable; }
+    void setChunkManifestWrite(bool enable) { chunkManifestWrite_ = enable; }
+    void setChunkVerify(bool enable) { chunkVerify_ = enable; }
     
     // Getters
     bool isErase() const { return eraseEnabled_; }
     bool isOptionLock() const { return optionLock_; }
+    bool isIndexCache() const { return indexCacheEnabled_; }
+    ReadMode getReadMode() const { return readMode_; }
+    bool isTarIndexWrite() const { return tarIndexWrite_; }
+    bool isChunkManifestWrite() const { return chunkManifestWrite_; }
+    bool isChunkVerify() const { return chunkVerify_; }
+    
+    // A file option was given as "-": a TAR read from stdin while flashing
+    bool hasStreamInput() const { return streamInput_; }
     
     // Path getters
     const std::string& getBootloaderPath() const { return blPath_; }
@@ -50,18 +71,89 @@ public:
     const std::vector<FirmwareInfo>& getFiles() const { return files_; }
     size_t getPITSize() const { return pitSize_; }
     
+    // Partition table supplied with -V (empty if none)
+    bool hasPIT() const { return pit_.getEntryCount() > 0; }
+    const PIT& getPIT() const { return pit_; }
+    
+    // Archive digests (.md5, .sha256), entries covered by checksum files
+    // packed inside a TAR and, with setChunkVerify(), the chunks of
+    // entries listed in a chunk manifest are computed by the HashService
+    // while parsing goes on. Waits for them, checks them and
+    // caches the verified results; call after the last file option and
+    // before createImage(). Returns false if anything failed.
+    bool awaitVerification();
+    
+    // Immutable snapshot for the download engines, taken after parsing
+    std::shared_ptr<const FirmwareImage> createImage() const;
+    
     // Parsing methods
     bool parseBinary(const std::string& path);
     
+    // Fill in what a TAR entry's name and leading bytes tell about it.
+    // Returns false for entries that are not flashed (checksum files).
+    static bool describeTarEntry(const TarEntry& entry, const char* probe, size_t probeSize,
+                                 FirmwareInfo& info);
+
 private:
-    bool parseBinaryInternal(const std::string& path);
-    bool parseTAR(const std::string& path, FirmwareType type);
+    // record collects what the index cache stores; its identity is
+    // cleared when the result must not be cached
+    bool parseBinaryInternal(const std::string& path, IndexCacheRecord* record);
+    bool parseTAR(const std::string& path, FirmwareType type, IndexCacheRecord* record);
     bool parseBIN(const std::string& path, FirmwareType type);
+    bool parseZIP(const std::string& path);
+    bool parseStream(const std::string& path, std::vector<SourceStage> stages);
+    bool parseTarStream(std::unique_ptr<ByteSource> source, const std::string& path,
+                        const std::vector<SourceStage>& stages);
+    bool parseStreamPayload(ByteSource& source, const char* header, size_t headerSize,
+                            const std::string& path, const std::vector<SourceStage>& stages);
+    void addTarEntry(const TarEntry& entry, FirmwareType type, const std::string& sourcePath,
+                     const char* probe, size_t probeSize);
+    bool loadFromIndex(const std::string& path, const IndexCacheRecord& record);
+    
+    // Chunk manifest (path + ".chunks") of the TAR whose entries start at files_[firstFile]
+    bool writeChunkManifest(const Tar& tar, const std::string& path);
+    void attachChunkManifest(const std::string& path, size_t firstFile);
     
-    bool verifyMD5(const std::string& path);
-    bool verifySHA256(const std::string& path);
-    void extractGzipFile(const std::string& src, const std::string& dst);
-    bool parseLZ4FrameHeader(const char* data, FirmwareInfo& info);
+    // A digest listed in a .md5/.sha256 entry packed inside a TAR
+    struct EmbeddedDigest {
+        std::string target;         // Entry it covers
+        HashAlgorithm algorithm;
+        Digest digest;
+    };
+    static bool parseChecksumEntry(const std::string& entryName, const std::string& contents,
+                                   std::vector<EmbeddedDigest>& digests);
+    
+    // Hash every entry of an open TAR that a checksum entry covers
+    void queueEmbeddedChecks(const Tar& tar, const std::string& path);
+    
+    // An archive digest still being computed, and the index cache record
+    // to store once it checks out
+    struct PendingVerification {
+        std::string path;
+        HashAlgorithm algorithm;
+        std::shared_future<std::string> digest;
+        IndexCacheRecord record;
+        bool cacheable;
+    };
+    
+    // An entry being hashed against a checksum packed with it
+    struct PendingEntryCheck {
+        std::string path;
+        std::string name;
+        Digest expected;
+        std::shared_future<std::string> digest;
+    };
+    
+    // Chunks of one payload being hashed against its chunk manifest
+    struct PendingChunks {
+        std::string path;
+        std::shared_ptr<const ChunkedEntry> entry;
+        std::vector<std::shared_future<std::string>> digests;
+    };
+    
+    bool verifyMD5(const std::string& path, const std::string& digest);
+    bool verifySHA256(const std::string& path, const std::string& digest);
+    static bool parseLZ4FrameHeader(const char* data, FirmwareInfo& info);
     
     // File paths
     std::string blPath_;
@@ -74,14 +166,25 @@ private:
     // Options
     bool eraseEnabled_;
     bool optionLock_;
+    bool indexCacheEnabled_;
+    ReadMode readMode_;
+    bool tarIndexWrite_;
+    bool chunkManifestWrite_;
+    bool chunkVerify_;
+    bool streamInput_;
     
     // Parsed data
     std::vector<FirmwareInfo> files_;
     size_t pitSize_;
     size_t pitOffset_;
+    PIT pit_;
     
     // SHA256 manifest
     std::string sha256Expected_;
+    
+    std::vector<PendingVerification> pending_;
+    std::vector<PendingEntryCheck> pendingEntries_;
+    std::vector<PendingChunks> pendingChunks_;
 };
 
 } // namespace Odin
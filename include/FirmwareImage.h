@@ -0,0 +1,113 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * FirmwareImage - Immutable firmware snapshot shared by all devices
+ */
+
+#ifndef FIRMWARE_IMAGE_H
+#define FIRMWARE_IMAGE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include "ByteSource.h"
+#include "FirmwareInfo.h"
+#include "PIT.h"
+
+namespace Odin {
+
+class FirmwareData;
+
+// Snapshot of a fully parsed FirmwareData. It is built once after
+// argument parsing and never modified, so every device thread can hold
+// the same instance without copying or locking. Anything that differs
+// per device (device PIT, partition targets, progress) lives in the
+// DownloadEngine.
+class FirmwareImage {
+public:
+    static const std::string TAG;
+    
+    explicit FirmwareImage(const FirmwareData& data);
+    
+    // Non-copyable, share through std::shared_ptr<const FirmwareImage>
+    FirmwareImage(const FirmwareImage&) = delete;
+    FirmwareImage& operator=(const FirmwareImage&) = delete;
+    
+    // Options
+    bool isErase() const { return eraseEnabled_; }
+    bool isOptionLock() const { return optionLock_; }
+    ReadMode getReadMode() const { return readMode_; }
+    
+    // TAR on standard input, flashed after the files in flash order
+    bool hasStreamInput() const { return streamInput_; }
+    std::unique_ptr<ByteSource> openStreamInput() const;
+    
+    // Files in flash order
+    const std::vector<FirmwareInfo>& getFiles() const { return files_; }
+    
+    // Supplied PIT (-V)
+    const std::string& getPITPath() const { return pitPath_; }
+    size_t getPITSize() const { return pitSize_; }
+    bool hasPIT() const { return pit_.getEntryCount() > 0; }
+    const PIT& getPIT() const { return pit_; }
+    
+    // Resolve the PIT entry for every file. targets is indexed like
+    // getFiles() (an empty Entry for the PIT file itself) and reads the
+    // PIT in place; filenames no PIT entry names are appended to
+    // unmapped. Returns false if there are any.
+    bool mapPartitions(const PIT& pit, std::vector<PITView::Entry>& targets,
+                       std::vector<std::string>& unmapped) const;
+    
+    // PIT entry for a single firmware filename, an empty Entry if none
+    static PITView::Entry findTarget(const PIT& pit, const std::string& filename);
+    
+    // Stack the stages that yield a file's payload: the source file,
+    // any ZIP/gzip containers, the TAR entry window and, for LZ4 images,
+    // frame validation. Safe to call from several device threads at
+    // once; payloads are never kept resident. File reads are reported to
+    // cache, if given.
+    std::unique_ptr<ByteSource> openSource(const FirmwareInfo& info,
+                                           PageCache::Reader* cache = nullptr) const;
+    
+    // Add the checks the payload format allows (LZ4 frame validation)
+    static std::unique_ptr<ByteSource> validatePayload(std::unique_ptr<ByteSource> source,
+                                                       const FirmwareInfo& info);
+
+private:
+    std::vector<FirmwareInfo> files_;
+    std::string pitPath_;
+    size_t pitSize_;
+    PIT pit_;
+    bool eraseEnabled_;
+    bool optionLock_;
+    ReadMode readMode_;
+    bool streamInput_;
+};
+
+// Per-device reader for payloads in flash order. A compressed container
+// has no random access, so instead of decoding it from the start for
+// every payload, the decoded stream is kept open and consecutive
+// payloads of the same container are reached by decoding forward. Each
+// container is then decoded once per device.
+//
+// The cursor registers as a page cache reader of every source file when
+// it is created, so other devices keep the pages it has yet to read.
+class PayloadCursor {
+public:
+    explicit PayloadCursor(const FirmwareImage& image);
+    
+    // The returned source may read from the cursor's container, so it
+    // must be destroyed before the next open() and before the cursor
+    std::unique_ptr<ByteSource> open(const FirmwareInfo& info);
+
+private:
+    const FirmwareImage& image_;
+    std::unique_ptr<ByteSource> container_;
+    std::string containerPath_;
+    std::vector<SourceStage> containerStages_;
+    std::map<std::string, std::unique_ptr<PageCache::Reader>> readers_;   // By source path
+};
+
+} // namespace Odin
+
+#endif // FIRMWARE_IMAGE_H
@@ -8,10 +8,13 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <cstdint>
 
 namespace Odin {
 
+struct ChunkedEntry;
+
 // Firmware file types (from decompiled code)
 enum class FirmwareType {
     Unknown = 0,
@@ -30,18 +33,36 @@ enum class CompressionType {
     GZIP = 2
 };
 
+// Container layer between sourcePath and the bytes offset refers to
+enum class SourceStageKind {
+    ZipMember = 1,      // Member of a ZIP archive (only as the first stage)
+    Gzip = 2            // gzip stream
+};
+
+struct SourceStage {
+    SourceStageKind kind;
+    std::string name;               // ZIP member name
+    
+    SourceStage(SourceStageKind k, const std::string& n = "") : kind(k), name(n) {}
+};
+
 struct FirmwareInfo {
     std::string filename;           // Original filename
     std::string partitionName;      // Target partition name
+    std::string sourcePath;         // File the payload is read from
+    std::vector<SourceStage> sourceStages;  // Containers unwrapped, outermost first;
+                                            // offset is within the innermost one
     FirmwareType type;
     
-    size_t offset;                  // Offset in archive (for TAR)
-    size_t size;                    // Compressed size
-    size_t uncompressedSize;        // Uncompressed size (if applicable)
+    uint64_t offset;                // Offset of the payload in its container
+    uint64_t size;                  // Compressed size
+    uint64_t uncompressedSize;      // Uncompressed size (if applicable)
     
     CompressionType compression;
     
-    std::shared_ptr<char[]> data;   // File data in memory
+    std::string sha256;             // Expected digest of the payload, from the .odinidx sidecar
+                                    // or a packed .sha256 file (empty if unknown)
+    std::shared_ptr<const ChunkedEntry> chunks;     // Chunk digests of the payload (null if unknown)
     
     // LZ4 frame header info
     uint32_t lz4BlockSizeId;
@@ -68,6 +89,9 @@ constexpr uint16_t GZIP_MAGIC = 0x1F8B;
 constexpr char TAR_MAGIC[] = "ustar";
 constexpr uint32_t DEVINFO_MAGIC = 0x12345678;
 
+// Bytes read from a payload to detect and parse an LZ4 frame header
+constexpr size_t LZ4_HEADER_PROBE_SIZE = 32;
+
 } // namespace Odin
 
 #endif // FIRMWARE_INFO_H
@@ -0,0 +1,80 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * FlashPlan - Pre-flight check of firmware files against the PIT
+ */
+
+#ifndef FLASH_PLAN_H
+#define FLASH_PLAN_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "FirmwareImage.h"
+#include "FirmwareInfo.h"
+#include "PIT.h"
+
+namespace Odin {
+
+// Payload throughput assumed for the duration estimate, in bytes per
+// second. Download mode on USB 2.0 sustains a little above this.
+constexpr uint64_t PLAN_TRANSFER_RATE = 30ULL * 1024 * 1024;
+
+// FileSubCmd::SetInfo carries the payload size as a 32-bit int
+constexpr uint64_t PLAN_MAX_TRANSFER_SIZE = 0x7FFFFFFF;
+
+// One firmware file as it will be flashed
+struct PlannedTransfer {
+    size_t fileIndex;           // Into FirmwareImage::getFiles()
+    PITView::Entry target;
+    uint64_t sendBytes;         // Payload sent over USB
+    uint64_t writeBytes;        // Written to the partition; for LZ4 frames
+                                // without a content size, a lower bound
+    uint64_t partitionBytes;    // 0 if the PIT does not give a size
+    double seconds;
+    
+    PlannedTransfer()
+        : fileIndex(0), sendBytes(0), writeBytes(0), partitionBytes(0), seconds(0) {}
+};
+
+// The transfers of one device, resolved against the PIT it will have
+// (the supplied one if any). Problems the device would only report
+// mid-flash, as writeProtectionFail codes, are found here before the
+// first byte is sent.
+class FlashPlan {
+public:
+    static const std::string TAG;
+    
+    FlashPlan();
+    
+    // targets as filled in by FirmwareImage::mapPartitions; false if any
+    // file cannot fit its partition or is too large for one transfer,
+    // with one line per problem
+    bool build(const FirmwareImage& firmware, const std::vector<PITView::Entry>& targets,
+               std::vector<std::string>& problems);
+    
+    const std::vector<PlannedTransfer>& getTransfers() const { return transfers_; }
+    uint64_t getTotalBytes() const { return totalBytes_; }
+    double getExpectedSeconds() const { return expectedSeconds_; }
+    
+    void print() const;
+    
+    // Size of a partition from its block count and the block size of its
+    // device type (512 for MMC, 4096 for UFS); 0 where that is not known
+    static uint64_t partitionBytes(const PITView::Entry& entry);
+    
+    // Whether a payload fits its partition; an empty problem if it does
+    static std::string checkSize(const FirmwareInfo& info, const PITView::Entry& target);
+    
+    // Whether the payload size fits the SetInfo field; an empty problem
+    // if it does
+    static std::string checkTransferSize(const FirmwareInfo& info);
+
+private:
+    std::vector<PlannedTransfer> transfers_;
+    uint64_t totalBytes_;
+    double expectedSeconds_;
+};
+
+} // namespace Odin
+
+#endif // FLASH_PLAN_H
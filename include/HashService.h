@@ -0,0 +1,72 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * HashService - Concurrent hashing of files and byte ranges
+ */
+
+#ifndef HASH_SERVICE_H
+#define HASH_SERVICE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+
+namespace Odin {
+
+enum class HashAlgorithm {
+    MD5,
+    SHA256
+};
+
+// Hash to the end of the file
+constexpr uint64_t HASH_TO_END = ~static_cast<uint64_t>(0);
+
+// A file, or [offset, offset + length) of one, to hash
+struct HashJob {
+    std::string path;
+    HashAlgorithm algorithm;
+    uint64_t offset;
+    uint64_t length;
+    
+    HashJob(const std::string& p, HashAlgorithm a, uint64_t o = 0, uint64_t l = HASH_TO_END)
+        : path(p), algorithm(a), offset(o), length(l) {}
+};
+
+// Worker pool that hashes files and byte ranges concurrently, each job
+// with large sequential reads on one worker. Results are lowercase hex
+// digests, empty if the range could not be read. Callers keep working
+// and wait on the future only when they need the digest.
+class HashService {
+public:
+    static const std::string TAG;
+    
+    static HashService& instance();
+    
+    // Queued jobs are dropped and running ones stopped at the next read
+    ~HashService();
+    
+    std::future<std::string> submit(const HashJob& job);
+    std::vector<std::future<std::string>> submit(const std::vector<HashJob>& jobs);
+    
+    size_t getWorkerCount() const { return workerCount_; }
+
+private:
+    HashService();
+    void run();
+    
+    std::mutex mutex_;
+    std::condition_variable queued_;
+    std::deque<std::packaged_task<std::string()>> queue_;
+    std::vector<std::thread> workers_;     // Started with the first job
+    size_t workerCount_;
+    std::atomic<bool> stopping_;
+};
+
+} // namespace Odin
+
+#endif // HASH_SERVICE_H
@@ -0,0 +1,79 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * IndexCache - Persistent on-disk cache of parsed firmware indexes
+ */
+
+#ifndef INDEX_CACHE_H
+#define INDEX_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "FirmwareInfo.h"
+#include "Tar.h"
+
+namespace Odin {
+
+// Identity of a firmware file on disk. A cached index is only valid
+// while every field still matches the file being parsed.
+struct FileIdentity {
+    std::string path;       // Canonical (realpath) path
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtimeNs;
+    int64_t ctimeNs;
+    
+    FileIdentity() : inode(0), size(0), mtimeNs(0), ctimeNs(0) {}
+    
+    // Stat a file and fill in its identity
+    static bool fromPath(const std::string& path, FileIdentity& identity);
+    
+    bool operator==(const FileIdentity& other) const {
+        return path == other.path && inode == other.inode && size == other.size &&
+               mtimeNs == other.mtimeNs && ctimeNs == other.ctimeNs;
+    }
+    bool operator!=(const FileIdentity& other) const { return !(*this == other); }
+};
+
+// Everything FirmwareData derives from one input file
+struct IndexCacheRecord {
+    FileIdentity identity;
+    std::vector<TarEntry> entries;      // Empty for non-TAR inputs
+    std::vector<FirmwareInfo> files;    // Metadata only, data is never stored
+    std::string md5;                    // Verified digests (empty if not computed)
+    std::string sha256;
+};
+
+class IndexCache {
+public:
+    static const std::string TAG;
+    
+    // Uses defaultDirectory() when directory is empty
+    explicit IndexCache(const std::string& directory = "");
+    ~IndexCache();
+    
+    // $XDG_CACHE_HOME/odin4/index or ~/.cache/odin4/index; empty, and
+    // the cache off, if neither is set
+    static std::string defaultDirectory();
+    
+    // Load the record for a file. Fails if there is none or the key no
+    // longer matches the file's identity.
+    bool load(const FileIdentity& identity, IndexCacheRecord& record) const;
+    
+    // Store a record, replacing any previous one for the same path
+    bool store(const IndexCacheRecord& record) const;
+    
+    // Remove the record for a path
+    void invalidate(const std::string& path) const;
+    
+    const std::string& getDirectory() const { return directory_; }
+
+private:
+    std::string recordPath(const std::string& path) const;
+    
+    std::string directory_;
+};
+
+} // namespace Odin
+
+#endif // INDEX_CACHE_H
@@ -7,12 +7,102 @@
 #define MANIFEST_H
 
 #include <string>
-#include <map>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+#include "Digest.h"
+#include "HashService.h"
 
 namespace Odin {
 
+class ByteSource;
+
+// Incremental SHA-256, for data that is only seen in pieces
+class Sha256 {
+public:
+    Sha256();
+    ~Sha256();
+    
+    Sha256(const Sha256&) = delete;
+    Sha256& operator=(const Sha256&) = delete;
+    
+    void update(const char* data, size_t size);
+    
+    // The object cannot be updated afterwards
+    Digest final();
+    std::string finalHex() { return final().hex(); }
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+// Sha256 computed on a helper thread, so the thread producing the data
+// never waits for the hash. update() queues a reference to the caller's
+// buffer, which must stay unchanged until wait() on the returned ticket
+// (or finalHex()) has returned.
+class AsyncSha256 {
+public:
+    AsyncSha256();
+    ~AsyncSha256();
+    
+    AsyncSha256(const AsyncSha256&) = delete;
+    AsyncSha256& operator=(const AsyncSha256&) = delete;
+    
+    uint64_t update(const char* data, size_t size);
+    
+    // Block until the buffer with this ticket and all before it are hashed
+    void wait(uint64_t ticket);
+    
+    // Digest of everything queued; the next update() starts a new one
+    std::string finalHex();
+    
+    // Drop what is queued and wait out the buffer being hashed, so the
+    // caller may free its buffers; the next update() starts a new digest
+    void discard();
+
+private:
+    void run();
+    
+    std::mutex mutex_;
+    std::condition_variable queued_;
+    std::condition_variable hashed_;
+    std::deque<std::pair<const char*, size_t>> pending_;
+    uint64_t submitted_;        // Tickets handed out
+    uint64_t completed_;        // Tickets hashed
+    std::unique_ptr<Sha256> hash_;
+    bool busy_;                 // The worker is reading a caller's buffer
+    bool stopping_;
+    std::thread worker_;
+};
+
+// Incremental MD5, same interface as Sha256
+class Md5 {
+public:
+    Md5();
+    ~Md5();
+    
+    Md5(const Md5&) = delete;
+    Md5& operator=(const Md5&) = delete;
+    
+    void update(const char* data, size_t size);
+    Digest final();
+    std::string finalHex() { return final().hex(); }
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
 class Manifest {
 public:
+    static const std::string TAG;
+    
     explicit Manifest(const std::string& path);
     ~Manifest();
     
@@ -22,20 +112,39 @@ public:
     // Verify a file against manifest
     bool verify(const std::string& filename) const;
     
-    // Get expected hash for a file
+    // Verify many files at once, hashed concurrently on the HashService.
+    // True if all match; names that are missing from the manifest or do
+    // not match are added to failed, if given.
+    bool verify(const std::vector<std::string>& filenames, std::vector<std::string>* failed = nullptr) const;
+    
+    // Get expected hash for a file (lowercase hex, empty if not listed)
     std::string getHash(const std::string& filename) const;
+    const Digest* findHash(std::string_view filename) const { return hashes_.find(filename); }
+    
+    // Hash a file or a range of one on the calling thread. stop, if
+    // given, aborts between reads (the result is then empty). Digests
+    // of whole files are looked up in and added to the DigestCache.
+    static std::string calculate(const HashJob& job, const std::atomic<bool>* stop = nullptr);
     
     // Calculate SHA256 of a file
     static std::string calculateSHA256(const std::string& path);
     static std::string calculateSHA256(const char* data, size_t size);
     
+    // Hash everything left in a stage (empty on read error)
+    static std::string calculate(ByteSource& source, HashAlgorithm algorithm);
+    static std::string calculateSHA256(ByteSource& source);
+    
     // Calculate MD5 of a file
     static std::string calculateMD5(const std::string& path);
     static std::string calculateMD5(const char* data, size_t size);
-    
+
 private:
+    static std::string hashRange(const HashJob& job, const std::atomic<bool>* stop);
+    
     std::string path_;
-    std::map<std::string, std::string> hashes_;  // filename -> hash
+    std::string filePath(const std::string& filename) const;
+    
+    DigestMap hashes_;      // MD5 or SHA-256 by filename
     bool loaded_;
 };
 
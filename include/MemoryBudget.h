@@ -0,0 +1,74 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * MemoryBudget - Process-wide cap on firmware buffer memory
+ */
+
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <cstddef>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+
+namespace Odin {
+
+// Tracks payload and transfer buffer memory across all device threads.
+// Readers acquire before allocating and block while the cap would be
+// exceeded (backpressure). A request larger than the whole cap is still
+// admitted once nothing else is held, so a single oversized buffer can
+// never deadlock a run.
+class MemoryBudget {
+public:
+    static const std::string TAG;
+    
+    // RAII reservation, releases its bytes on destruction
+    class Lease {
+    public:
+        Lease() : budget_(nullptr), bytes_(0) {}
+        Lease(MemoryBudget* budget, size_t bytes) : budget_(budget), bytes_(bytes) {}
+        ~Lease() { reset(); }
+        
+        Lease(Lease&& other) noexcept : budget_(other.budget_), bytes_(other.bytes_) {
+            other.budget_ = nullptr;
+            other.bytes_ = 0;
+        }
+        Lease& operator=(Lease&& other) noexcept;
+        
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        
+        size_t size() const { return bytes_; }
+        void reset();
+    
+    private:
+        MemoryBudget* budget_;
+        size_t bytes_;
+    };
+    
+    static MemoryBudget& instance();
+    
+    // 0 means unlimited (the default)
+    void setLimit(size_t bytes);
+    size_t getLimit() const;
+    
+    // Block until bytes fit under the cap, then account for them
+    Lease acquire(size_t bytes);
+    
+    size_t getUsage() const;
+    size_t getPeak() const;
+
+private:
+    MemoryBudget();
+    void release(size_t bytes);
+    
+    mutable std::mutex mutex_;
+    std::condition_variable available_;
+    size_t limit_;
+    size_t usage_;
+    size_t peak_;
+};
+
+} // namespace Odin
+
+#endif // MEMORY_BUDGET_H
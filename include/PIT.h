@@ -9,7 +9,11 @@
 #define PIT_H
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <cstdint>
 
 namespace Odin {
@@ -70,22 +74,97 @@ struct PITEntry {
     {}
 };
 
+// PIT in a caller's buffer, validated once (magic, entry count against
+// the buffer size) and then read in place: entries are views over the
+// raw 132-byte records and names are string_views into them, with the
+// name lookups built up front. Nothing is copied, so the buffer must
+// outlive the view and every Entry taken from it.
+class PITView {
+public:
+    class Entry {
+    public:
+        Entry() : raw_(nullptr) {}
+        explicit Entry(const char* raw) : raw_(raw) {}
+        
+        // False for the Entry returned when a lookup finds nothing
+        explicit operator bool() const { return raw_ != nullptr; }
+        
+        PITBinaryType binaryType() const { return static_cast<PITBinaryType>(field(0)); }
+        PITDeviceType deviceType() const { return static_cast<PITDeviceType>(field(1)); }
+        uint32_t partitionId() const { return field(2); }
+        uint32_t attributes() const { return field(3); }
+        uint32_t updateAttributes() const { return field(4); }
+        uint32_t blockSizeOrOffset() const { return field(5); }
+        uint32_t blockCount() const { return field(6); }
+        uint32_t fileOffset() const { return field(7); }
+        uint32_t fileSize() const { return field(8); }
+        std::string_view partitionName() const { return name(36, PIT_PARTITION_NAME_LEN); }
+        std::string_view flashFilename() const { return name(68, PIT_FLASH_FILENAME_LEN); }
+        std::string_view fotaFilename() const { return name(100, PIT_FOTA_FILENAME_LEN); }
+        
+        // Owning copy
+        PITEntry toEntry() const;
+    
+    private:
+        uint32_t field(size_t index) const;
+        std::string_view name(size_t offset, size_t length) const;
+        
+        const char* raw_;
+    };
+    
+    PITView();
+    
+    // Validate and index; on failure the view is left empty
+    bool parse(const char* data, size_t size);
+    
+    size_t getEntryCount() const { return count_; }
+    Entry getEntry(size_t index) const;
+    std::string_view getGangName() const { return gangName_; }
+    std::string_view getProjectName() const { return projectName_; }
+    
+    // Position of the first entry with this name, getEntryCount() if none
+    size_t findPartition(std::string_view partitionName) const;
+    size_t findFilename(std::string_view filename) const;      // Flash or FOTA
+    
+    Entry findEntry(std::string_view partitionName) const;
+    Entry findEntryByFilename(std::string_view filename) const;
+
+private:
+    const char* entries_;       // First raw entry
+    size_t count_;
+    std::string_view gangName_;
+    std::string_view projectName_;
+    
+    // Name -> position; the first entry carrying a name wins
+    std::unordered_map<std::string_view, size_t> byPartition_;
+    std::unordered_map<std::string_view, size_t> byFlashFilename_;
+    std::unordered_map<std::string_view, size_t> byFotaFilename_;
+};
+
+// Owning PIT: keeps one copy of the raw bytes and reads them through a
+// PITView. The PITEntry list with its owned strings is only built the
+// first time something asks for it.
 class PIT {
 public:
     PIT();
+    PIT(const PIT& other);
+    PIT& operator=(const PIT& other);
     ~PIT();
     
     // Parse PIT data
     bool parse(const char* data, size_t size);
     
+    // Zero-copy access to the parsed table
+    const PITView& view() const { return view_; }
+    
     // Get entries
-    const std::vector<PITEntry>& getEntries() const { return entries_; }
-    size_t getEntryCount() const { return entries_.size(); }
+    const std::vector<PITEntry>& getEntries() const;
+    size_t getEntryCount() const { return view_.getEntryCount(); }
     
     // Find entry by partition name
     const PITEntry* findEntry(const std::string& partitionName) const;
     
-    // Find entry by flash filename
+    // Find entry by flash or FOTA filename
     const PITEntry* findEntryByFilename(const std::string& filename) const;
     
     // Serialize to binary
@@ -93,12 +172,14 @@ public:
     
     // Debug output
     void print() const;
-    
+
 private:
-    std::vector<PITEntry> entries_;
-    uint32_t headerCount_;
-    std::string gangName_;
-    std::string projectName_;
+    std::vector<char> raw_;
+    PITView view_;              // Over raw_
+    
+    // Built on first use; a PIT is shared read-only between device threads
+    mutable std::unique_ptr<std::once_flag> entriesBuilt_;
+    mutable std::vector<PITEntry> entries_;
 };
 
 } // namespace Odin
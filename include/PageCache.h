@@ -0,0 +1,90 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * PageCache - Page cache policy for firmware reads
+ */
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Odin {
+
+// Readers report their position at this granularity
+constexpr uint64_t PAGE_CACHE_STEP = 0x800000;      // 8MB
+
+// Requested ahead of each reader (WILLNEED)
+constexpr uint64_t PAGE_CACHE_AHEAD = 0x4000000;    // 64MB
+
+// Keeps multi-GB firmware reads from flooding the page cache. Every
+// device registers a Reader per source file before its transfer starts;
+// file stages report how far they got. Pages ahead of a reader are
+// requested, pages all readers of the file have passed are dropped, so
+// devices flashing the same archive share its pages until the slowest
+// one is done with them. The rest of the file is dropped when its last
+// reader detaches.
+class PageCache {
+public:
+    static const std::string TAG;
+    
+    struct File;
+    
+    // One consumer's position in a file, registered until destruction
+    class Reader {
+    public:
+        ~Reader();
+        
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+        
+        // The consumer has read the file up to offset. Cheap unless the
+        // position moved back or a step further since the last report.
+        void advance(uint64_t offset) {
+            if (offset < reported_ || offset - reported_ >= PAGE_CACHE_STEP) {
+                cache_.update(*this, offset);
+            }
+        }
+    
+    private:
+        friend class PageCache;
+        Reader(PageCache& cache, File* file, size_t slot)
+            : cache_(cache), file_(file), slot_(slot), reported_(0) {}
+        
+        PageCache& cache_;
+        File* file_;
+        size_t slot_;
+        uint64_t reported_;
+    };
+    
+    static PageCache& instance();
+    
+    // Register a consumer of path positioned at its start, nullptr if
+    // the file cannot be opened
+    std::unique_ptr<Reader> attach(const std::string& path);
+    
+    // Drop pages behind the readers (the default). When disabled the
+    // policy only requests pages ahead, leaving the file cached for a
+    // following run.
+    void setDropBehind(bool enable);
+    bool isDropBehind() const;
+
+private:
+    PageCache();
+    void update(Reader& reader, uint64_t offset);
+    void detach(Reader& reader);
+    void dropBehind(File& file);
+    
+    mutable std::mutex mutex_;
+    std::map<std::pair<uint64_t, uint64_t>, std::unique_ptr<File>> files_;   // By device, inode
+    bool dropBehind_;
+};
+
+} // namespace Odin
+
+#endif // PAGE_CACHE_H
@@ -0,0 +1,81 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * PitCache - Device PITs shared across devices of the same model
+ */
+
+#ifndef PIT_CACHE_H
+#define PIT_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include "PIT.h"
+#include "Digest.h"
+#include "FirmwareImage.h"
+
+namespace Odin {
+
+// A device PIT as parsed once, with the partition plans already resolved
+// against it. Devices that report the same PIT bytes share one of these,
+// and PITView::Entry targets stay valid for as long as it is held.
+class CachedPit {
+public:
+    CachedPit(const std::string& product, const Digest& digest, const PIT& pit);
+    
+    const std::string& getProduct() const { return product_; }
+    const Digest& getDigest() const { return digest_; }
+    const PIT& getPIT() const { return pit_; }
+    
+    // FirmwareImage::mapPartitions against this PIT, done once per image;
+    // failed mappings are not kept
+    bool mapPartitions(const std::shared_ptr<const FirmwareImage>& firmware,
+                       std::vector<PITView::Entry>& targets,
+                       std::vector<std::string>& unmapped) const;
+
+private:
+    struct Plan {
+        std::weak_ptr<const FirmwareImage> firmware;
+        std::vector<PITView::Entry> targets;
+    };
+    
+    std::string product_;
+    Digest digest_;
+    PIT pit_;
+    
+    mutable std::mutex mutex_;
+    mutable std::vector<Plan> plans_;
+};
+
+// Device PITs keyed by USB product string and SHA-256 of the PIT bytes.
+// The download protocol has no way to ask for a digest, so the PIT is
+// still read from every device; it is a few kilobytes and its hash is
+// the check that a cached table applies. Tables live in memory and are
+// shared only between the devices of one run; nothing is kept on disk.
+class PitCache {
+public:
+    static const std::string TAG;
+    
+    static PitCache& instance();
+    
+    void setEnabled(bool enable) { enabled_ = enable; }
+    bool isEnabled() const { return enabled_; }
+    
+    // The shared table for these bytes, parsed on first sight; nullptr if
+    // they are not a valid PIT. Disabled, every call parses afresh.
+    std::shared_ptr<const CachedPit> acquire(const std::string& product, const char* data, size_t size);
+
+private:
+    PitCache();
+    
+    std::atomic<bool> enabled_;
+    
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const CachedPit>> pits_;  // Product + hex digest
+};
+
+} // namespace Odin
+
+#endif // PIT_CACHE_H
@@ -0,0 +1,63 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * Sha256Engine - SHA-256 with CPU-specific kernels
+ */
+
+#ifndef SHA256_ENGINE_H
+#define SHA256_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Odin {
+
+constexpr size_t SHA256_BLOCK_SIZE = 64;
+constexpr size_t SHA256_DIGEST_SIZE = 32;
+
+enum class Sha256Kernel {
+    Portable = 0,   // Plain C++
+    ShaNi = 1,      // x86 SHA extensions
+    ArmV8 = 2,      // ARMv8 cryptography extensions
+    Avx2 = 3        // Portable for one stream, 8 streams at once with AVX2
+};
+
+// SHA-256 compression with the fastest kernel the CPU offers, chosen at
+// runtime (CPUID on x86, HWCAP on ARM) so one binary runs everywhere.
+// Independent buffers can be hashed side by side: the AVX2 kernel runs
+// eight streams in the lanes of one register set, which on CPUs without
+// SHA instructions is several times faster than one stream at a time.
+class Sha256Engine {
+public:
+    // Kernel in use; picked on first call
+    static Sha256Kernel getKernel();
+    static const char* kernelName(Sha256Kernel kernel);
+    static bool isSupported(Sha256Kernel kernel);
+    
+    // Override the choice (benchmarks). Returns false if unsupported.
+    static bool setKernel(Sha256Kernel kernel);
+    
+    // Streams digestMany() hashes at once
+    static size_t getLanes();
+    
+    // Initial hash value
+    static void init(uint32_t state[8]);
+    
+    // Compress whole 64-byte blocks into state
+    static void compress(uint32_t state[8], const unsigned char* data, size_t blocks);
+    
+    // Pad and compress the final size (< 64) bytes of a message of
+    // totalSize bytes, then write the big-endian digest
+    static void finish(uint32_t state[8], const unsigned char* data, size_t size, uint64_t totalSize,
+                       unsigned char digest[SHA256_DIGEST_SIZE]);
+    
+    // Digest of one buffer
+    static void digest(const unsigned char* data, size_t size, unsigned char digest[SHA256_DIGEST_SIZE]);
+    
+    // Digests of count independent buffers, interleaved where the kernel allows
+    static void digestMany(const unsigned char* const* data, const size_t* sizes, size_t count,
+                           unsigned char (*digests)[SHA256_DIGEST_SIZE]);
+};
+
+} // namespace Odin
+
+#endif // SHA256_ENGINE_H
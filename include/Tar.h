@@ -9,20 +9,25 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <unordered_map>
 #include <cstdint>
+#include "ByteSource.h"
 
 namespace Odin {
 
 struct TarEntry {
     std::string name;
-    size_t size;
-    size_t offset;      // Offset of data in file
+    uint64_t size;
+    uint64_t offset;    // Offset of data in file
     bool isFile;
     bool isDirectory;
     uint32_t mode;
     uint32_t mtime;
 };
 
+// Entry reads are positional (pread on one shared descriptor), so once
+// open the const methods may be called from any number of threads.
 class Tar {
 public:
     static const std::string TAG;
@@ -32,30 +37,137 @@ public:
     
     // Open and parse TAR
     bool open();
+    
+    // Open using a previously parsed entry list, skipping the header walk
+    bool open(const std::vector<TarEntry>& entries);
     void close();
-    bool isOpen() const { return isOpen_; }
+    bool isOpen() const { return fd_ >= 0; }
+    
+    // Sidecar index kept next to the archive (path + ".odinidx"). open()
+    // takes the entry table from it when it still matches the archive.
+    static std::string indexPath(const std::string& path);
+    bool isIndexed() const { return indexed_; }
+    
+    // Write the sidecar for the open archive: entry table, the leading
+    // bytes of every entry (LZ4 frame headers) and a SHA-256 per entry.
+    // Reads the whole archive once; the digests are kept for this Tar.
+    bool writeIndex();
+    
+    // SHA-256 of an entry as recorded in the sidecar, empty if unknown
+    std::string getEntryDigest(const TarEntry& entry) const;
     
     // Get entries
     const std::vector<TarEntry>& getEntries() const { return entries_; }
     
-    // Find entry by name
+    // Find entry by full name or, failing that, by file name without the
+    // directory. Hashed; the first entry in archive order wins.
     const TarEntry* findEntry(const std::string& name) const;
     
     // Read entry data
     bool readEntry(const TarEntry& entry, char* buffer, size_t bufferSize) const;
     
+    // Read size bytes starting offset bytes into the entry
+    bool readEntryRange(const TarEntry& entry, uint64_t offset, char* buffer, size_t size) const;
+    
     // Iterate over entries
     using EntryCallback = std::function<bool(const TarEntry&)>;
     void forEach(EntryCallback callback) const;
     
+    // Parse and checksum one 512-byte header block (offset is left to the caller)
+    static bool parseHeader(const char* header, TarEntry& entry);
+    
+    // Check for an all-zero (end of archive) block
+    static bool isZeroBlock(const char* block);
+    
+    // Check a header block against its checksum field
+    static bool verifyChecksum(const char* block);
+
 private:
-    bool parseHeader(const char* header, TarEntry& entry);
-    size_t octalToDecimal(const char* str, size_t len);
+    static uint64_t octalToDecimal(const char* str, size_t len);
+    
+    bool readAt(uint64_t offset, char* buffer, size_t size) const;
+    
+    // Position of entry in entries_, entries_.size() if not found
+    size_t findIndex(const TarEntry& entry) const;
+    
+    bool loadIndex(uint64_t fileSize);
+    bool hashPrefix(uint64_t fileSize, std::string& digest) const;
+    
+    // Index the header at offset and set next to the following one, or
+    // set end at the end-of-archive block. Returns false if the header is
+    // invalid or its entry runs past the end of the file.
+    bool indexHeader(const char* block, uint64_t offset, uint64_t fileSize, uint64_t& next, bool& end);
+    
+    // Rebuild the name lookups after entries_ changed
+    void buildLookup();
     
     std::string path_;
-    FILE* file_;
-    bool isOpen_;
+    int fd_;
     std::vector<TarEntry> entries_;
+    
+    // Full name and file name -> position in entries_
+    std::unordered_map<std::string, size_t> byName_;
+    std::unordered_map<std::string, size_t> byBasename_;
+    
+    // From the sidecar, parallel to entries_ (empty when not indexed)
+    bool indexed_;
+    std::vector<std::string> heads_;
+    std::vector<std::string> digests_;
+};
+
+// Forward-only walk over a TAR stream in archive order, for inputs that
+// cannot seek (pipes, decompressors). Each entry's payload is read
+// through payload() before moving on; only one header block is ever
+// buffered. Entry offsets are positions in the stream.
+class TarStream {
+public:
+    explicit TarStream(std::unique_ptr<ByteSource> source);
+    
+    // Non-copyable
+    TarStream(const TarStream&) = delete;
+    TarStream& operator=(const TarStream&) = delete;
+    
+    // Advance to the next entry, skipping whatever is left of the current
+    // payload. Returns false at the end of the archive or on error.
+    bool next(TarEntry& entry);
+    
+    // Payload of the entry returned by the last next(), valid until the
+    // following call
+    ByteSource& payload() { return payload_; }
+    
+    bool hasError() const { return error_; }
+    
+    // Consume the rest of the input (end blocks, appended checksums) so
+    // trailing checks of the stages below run
+    bool drain();
+
+private:
+    // Window of the current entry's bytes in the shared stream
+    class PayloadSource : public ByteSource {
+    public:
+        explicit PayloadSource(ByteSource& upstream) : upstream_(upstream), length_(0), position_(0) {}
+        
+        void reset(uint64_t length) { length_ = length; position_ = 0; }
+        uint64_t remaining() const { return length_ - position_; }
+        
+        ssize_t read(char* buffer, size_t size) override;
+        uint64_t size() const override { return length_; }
+        uint64_t position() const override { return position_; }
+        bool skip(uint64_t bytes) override;
+        void readahead(uint64_t bytes) override { upstream_.readahead(bytes < remaining() ? bytes : remaining()); }
+        size_t bufferBytes() const override { return upstream_.bufferBytes(); }
+    
+    private:
+        ByteSource& upstream_;
+        uint64_t length_;
+        uint64_t position_;
+    };
+    
+    std::unique_ptr<ByteSource> source_;
+    PayloadSource payload_;
+    uint64_t padding_;          // Bytes after the current payload up to the next header
+    bool finished_;
+    bool error_;
 };
 
 } // namespace Odin
@@ -0,0 +1,104 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * UringSource - io_uring file stage with several reads in flight
+ */
+
+#ifndef URING_SOURCE_H
+#define URING_SOURCE_H
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <sys/uio.h>
+#include "ByteSource.h"
+
+namespace Odin {
+
+// File stage that keeps up to URING_QUEUE_DEPTH large aligned reads
+// queued on a private io_uring. Buffers and the file are registered with
+// the ring when the kernel allows it, so steady-state reads cost neither
+// a syscall per block nor a page pin per request. Slots are consumed in
+// file order and refilled as soon as they drain.
+//
+// Linux only; open() returns nullptr where io_uring is not available
+// (other systems, old kernels, seccomp), and the caller falls back to
+// buffered reads.
+class UringSource : public ByteSource {
+public:
+    static const std::string TAG;
+    
+    // Takes ownership of fd on success
+    static std::unique_ptr<UringSource> open(int fd, uint64_t offset, uint64_t length);
+    
+    ~UringSource() override;
+    
+    ssize_t read(char* buffer, size_t size) override;
+    uint64_t size() const override { return length_; }
+    uint64_t position() const override { return position_; }
+    bool skip(uint64_t bytes) override;
+    size_t bufferBytes() const override { return slotSize_ * slots_.size(); }
+    
+    void setCache(PageCache::Reader* cache) { cache_ = cache; }
+
+private:
+    enum class SlotState { Idle, InFlight, Ready };
+    
+    struct Slot {
+        char* buffer;
+        uint64_t offset;        // Relative to offset_
+        size_t length;          // Bytes requested
+        size_t filled;          // Bytes completed
+        size_t consumed;        // Bytes handed to the reader
+        SlotState state;
+    };
+    
+    UringSource(int fd, uint64_t offset, uint64_t length);
+    
+    bool setup();
+    bool queue(size_t index);
+    bool submitRead(size_t index);
+    bool submit(bool wait);
+    bool reap();
+    bool drain();
+    bool cancel();
+    
+    int fd_;
+    uint64_t offset_;
+    uint64_t length_;
+    uint64_t position_;
+    uint64_t nextOffset_;       // Next byte to queue
+    bool failed_;
+    bool closing_;              // Completions are only being collected
+    PageCache::Reader* cache_;
+    
+    // Ring
+    int ring_;
+    void* sqRing_;
+    size_t sqRingSize_;
+    void* cqRing_;
+    size_t cqRingSize_;
+    void* sqes_;
+    size_t sqesSize_;
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqMask_;
+    unsigned* sqArray_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned* cqMask_;
+    void* cqes_;
+    unsigned pending_;          // SQEs written but not yet submitted
+    bool fixedFile_;
+    bool fixedBuffers_;
+    
+    // Slots, consumed in ring order starting at head_
+    std::vector<Slot> slots_;
+    std::vector<struct iovec> iovecs_;
+    size_t slotSize_;
+    size_t head_;
+    char* buffers_;
+};
+
+} // namespace Odin
+
+#endif // URING_SOURCE_H
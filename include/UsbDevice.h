@@ -45,9 +45,15 @@ public:
     
     // Connection management
     virtual bool isValid() const = 0;
+    
+    // Guesses from the USB descriptors, which the session uses; the
+    // device info block may report otherwise in the DeviceProfile
     virtual bool isSystemLSI() const = 0;
     virtual bool isSupportedZLP() const = 0;
     
+    // USB product string, empty if the device has none
+    virtual const std::string& getProduct() const = 0;
+    
     // Data transfer
     virtual int write(const char* data, size_t size, unsigned int timeout = DEFAULT_TIMEOUT) = 0;
     virtual int read(char* buffer, size_t size, unsigned int timeout = DEFAULT_TIMEOUT, bool exactSize = false) = 0;
@@ -79,6 +85,7 @@ public:
     bool isValid() const override;
     bool isSystemLSI() const override;
     bool isSupportedZLP() const override;
+    const std::string& getProduct() const override;
     
     // Data transfer
     int write(const char* data, size_t size, unsigned int timeout = DEFAULT_TIMEOUT) override;
@@ -88,7 +95,7 @@ public:
     // Interface management
     int claimInterface(unsigned int interfaceNum) override;
     int releaseInterface() override;
-    
+
 private:
     bool initialize(const std::string& devicePath);
     void checkProductName(uint8_t productIndex);
@@ -105,6 +112,8 @@ private:
     int interfaceIndex_;
     int altSettingIndex_;
     
+    std::string product_;
+    
     bool valid_;
     bool systemLSI_;
     bool supportedZLP_;
@@ -0,0 +1,106 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * Zip - ZIP container reading (central directory and member streams)
+ */
+
+#ifndef ZIP_H
+#define ZIP_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "ByteSource.h"
+
+namespace Odin {
+
+// Compression methods we can stream
+enum class ZipMethod : uint16_t {
+    Stored = 0,
+    Deflated = 8
+};
+
+struct ZipMember {
+    std::string name;
+    uint16_t method;
+    uint16_t flags;
+    uint32_t crc32;
+    uint64_t compressedSize;
+    uint64_t uncompressedSize;
+    uint64_t localHeaderOffset;
+    uint64_t dataOffset;        // Start of the member data in the archive
+    
+    bool isStored() const { return method == static_cast<uint16_t>(ZipMethod::Stored); }
+};
+
+class Zip {
+public:
+    static const std::string TAG;
+    
+    explicit Zip(const std::string& path);
+    ~Zip();
+    
+    // Non-copyable
+    Zip(const Zip&) = delete;
+    Zip& operator=(const Zip&) = delete;
+    
+    // Open and read the central directory (ZIP64 aware)
+    bool open();
+    void close();
+    bool isOpen() const { return fd_ >= 0; }
+    
+    const std::string& getPath() const { return path_; }
+    
+    // Get members
+    const std::vector<ZipMember>& getMembers() const { return members_; }
+    
+    // Find member by name
+    const ZipMember* findMember(const std::string& name) const;
+    
+    // Check for a local file header signature
+    static bool isZip(const char* header, size_t size);
+
+private:
+    bool readAt(uint64_t offset, char* buffer, size_t size) const;
+    bool readCentralDirectory(uint64_t offset, uint64_t size, uint64_t count);
+    bool resolveDataOffset(ZipMember& member) const;
+    
+    std::string path_;
+    int fd_;
+    std::vector<ZipMember> members_;
+};
+
+// Stage over one member's uncompressed bytes. Stored members are read
+// in place, deflated members are inflated on the fly, so nothing is ever
+// extracted to disk. The CRC-32 is checked once the last byte has been
+// read, unless a stored member was seeked over.
+class ZipMemberSource : public ByteSource {
+public:
+    // Open the named member of the archive at path
+    static std::unique_ptr<ZipMemberSource> open(const std::string& path, const std::string& name,
+                                                 ReadMode mode, PageCache::Reader* cache = nullptr);
+    static std::unique_ptr<ZipMemberSource> open(const std::string& path, const ZipMember& member,
+                                                 ReadMode mode, PageCache::Reader* cache = nullptr);
+    
+    const ZipMember& getMember() const { return member_; }
+    
+    ssize_t read(char* buffer, size_t size) override;
+    uint64_t size() const override { return member_.uncompressedSize; }
+    uint64_t position() const override { return position_; }
+    bool skip(uint64_t bytes) override;
+    void readahead(uint64_t bytes) override { data_->readahead(bytes); }
+    size_t bufferBytes() const override { return data_->bufferBytes(); }
+
+private:
+    ZipMemberSource(const ZipMember& member, std::unique_ptr<ByteSource> data);
+    
+    ZipMember member_;
+    std::unique_ptr<ByteSource> data_;
+    uint64_t position_;
+    uint32_t crc_;
+    bool crcTracked_;           // False once a stored member was seeked over
+};
+
+} // namespace Odin
+
+#endif // ZIP_H
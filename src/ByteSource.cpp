@@ -0,0 +1,662 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * ByteSource - Byte stream stage implementation
+ */
+
+#include "ByteSource.h"
+#include "UringSource.h"
+#include "DirectSource.h"
+#include "Zip.h"
+#include "Log.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Odin {
+
+const std::string ByteSource::TAG = "ByteSource";
+
+// Compressed input buffered per inflate refill
+constexpr size_t INFLATE_INPUT_BUFFER_SIZE = 0x40000;  // 256KB
+
+// Scratch used when a stage has to decode and discard to skip
+constexpr size_t SKIP_BUFFER_SIZE = 0x10000;  // 64KB
+
+// zlib counts in uInt, so single inflate calls are capped
+constexpr size_t INFLATE_MAX_OUTPUT = 0x40000000;
+
+static uint32_t readLE32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool ByteSource::skip(uint64_t bytes) {
+    std::vector<char> scratch(static_cast<size_t>(std::min<uint64_t>(bytes, SKIP_BUFFER_SIZE)));
+    
+    while (bytes > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(bytes, scratch.size()));
+        ssize_t bytesRead = read(scratch.data(), chunk);
+        if (bytesRead <= 0) {
+            return false;
+        }
+        bytes -= static_cast<uint64_t>(bytesRead);
+    }
+    
+    return true;
+}
+
+bool ByteSource::readFully(char* buffer, size_t size) {
+    while (size > 0) {
+        ssize_t bytesRead = read(buffer, size);
+        if (bytesRead <= 0) {
+            return false;
+        }
+        buffer += bytesRead;
+        size -= static_cast<size_t>(bytesRead);
+    }
+    return true;
+}
+
+ssize_t ByteSource::readUpTo(char* buffer, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t bytesRead = read(buffer + total, size - total);
+        if (bytesRead < 0) {
+            return -1;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        total += static_cast<size_t>(bytesRead);
+    }
+    return static_cast<ssize_t>(total);
+}
+
+std::unique_ptr<ByteSource> ByteSource::openStream(int fd) {
+    return std::unique_ptr<ByteSource>(new StreamSource(fd));
+}
+
+std::unique_ptr<ByteSource> ByteSource::openFile(const std::string& path, ReadMode mode,
+                                                 uint64_t offset, uint64_t length,
+                                                 PageCache::Reader* cache) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        Log::error(TAG, "Failed to open: " + path);
+        return nullptr;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || offset > static_cast<uint64_t>(st.st_size)) {
+        Log::error(TAG, "Invalid range in: " + path);
+        ::close(fd);
+        return nullptr;
+    }
+    length = std::min<uint64_t>(length, static_cast<uint64_t>(st.st_size) - offset);
+    
+    if (mode == ReadMode::Mmap && length > 0) {
+        std::unique_ptr<MmapSource> mapped(new MmapSource(fd, offset, length));
+        if (mapped->isValid()) {
+            mapped->setCache(cache);
+            return std::unique_ptr<ByteSource>(mapped.release());
+        }
+        Log::info(TAG, "mmap failed, using buffered reads: " + path);
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            Log::error(TAG, "Failed to open: " + path);
+            return nullptr;
+        }
+    }
+    
+    if (mode == ReadMode::Direct && length > 0) {
+        std::unique_ptr<DirectSource> direct = DirectSource::open(fd, offset, length);
+        if (direct) {
+            return std::unique_ptr<ByteSource>(direct.release());
+        }
+        Log::debug(TAG, "Direct I/O refused, using buffered reads: " + path);
+    }
+    
+    // Payload reads are one forward pass, so the kernel may read ahead
+    // aggressively on this descriptor
+    if (cache && length > 0) {
+        posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_SEQUENTIAL);
+    }
+    
+    if (mode == ReadMode::Uring && length > 0) {
+        std::unique_ptr<UringSource> ring = UringSource::open(fd, offset, length);
+        if (ring) {
+            ring->setCache(cache);
+            return std::unique_ptr<ByteSource>(ring.release());
+        }
+        Log::debug(TAG, "io_uring unavailable, using buffered reads: " + path);
+    }
+    
+    std::unique_ptr<FileSource> file(new FileSource(fd, offset, length));
+    file->setCache(cache);
+    return std::unique_ptr<ByteSource>(file.release());
+}
+
+// FileSource
+
+FileSource::FileSource(int fd, uint64_t offset, uint64_t length)
+    : fd_(fd)
+    , offset_(offset)
+    , length_(length)
+    , position_(0)
+    , cache_(nullptr)
+{
+}
+
+FileSource::~FileSource() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+ssize_t FileSource::read(char* buffer, size_t size) {
+    size = static_cast<size_t>(std::min<uint64_t>(size, length_ - position_));
+    if (size == 0) {
+        return 0;
+    }
+    
+    ssize_t bytesRead;
+    do {
+        bytesRead = pread(fd_, buffer, size, static_cast<off_t>(offset_ + position_));
+    } while (bytesRead < 0 && errno == EINTR);
+    
+    if (bytesRead < 0) {
+        Log::error(TAG, "Read failed: " + std::string(strerror(errno)));
+        return -1;
+    }
+    if (bytesRead == 0) {
+        Log::error(TAG, "File shorter than expected");
+        return -1;
+    }
+    
+    position_ += static_cast<uint64_t>(bytesRead);
+    if (cache_) {
+        cache_->advance(offset_ + position_);
+    }
+    return bytesRead;
+}
+
+bool FileSource::skip(uint64_t bytes) {
+    if (bytes > length_ - position_) {
+        return false;
+    }
+    position_ += bytes;
+    return true;
+}
+
+void FileSource::readahead(uint64_t bytes) {
+    bytes = std::min<uint64_t>(bytes, length_ - position_);
+    if (bytes > 0) {
+        posix_fadvise(fd_, static_cast<off_t>(offset_ + position_), static_cast<off_t>(bytes),
+                      POSIX_FADV_WILLNEED);
+    }
+}
+
+// StreamSource
+
+ssize_t StreamSource::read(char* buffer, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    
+    ssize_t bytesRead;
+    do {
+        bytesRead = ::read(fd_, buffer, size);
+    } while (bytesRead < 0 && errno == EINTR);
+    
+    if (bytesRead < 0) {
+        Log::error(TAG, "Read failed: " + std::string(strerror(errno)));
+        return -1;
+    }
+    
+    position_ += static_cast<uint64_t>(bytesRead);
+    return bytesRead;
+}
+
+// MmapSource
+
+MmapSource::MmapSource(int fd, uint64_t offset, uint64_t length)
+    : base_(nullptr)
+    , mapLength_(0)
+    , delta_(0)
+    , offset_(offset)
+    , length_(length)
+    , position_(0)
+    , cache_(nullptr)
+    , released_(0)
+{
+    uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t alignedOffset = offset & ~(pageSize - 1);
+    
+    delta_ = static_cast<size_t>(offset - alignedOffset);
+    mapLength_ = static_cast<size_t>(delta_ + length);
+    
+    void* base = mmap(nullptr, mapLength_, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(alignedOffset));
+    if (base != MAP_FAILED) {
+        base_ = static_cast<char*>(base);
+        madvise(base_, mapLength_, MADV_SEQUENTIAL);
+    }
+    
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+}
+
+MmapSource::~MmapSource() {
+    if (base_) {
+        munmap(base_, mapLength_);
+    }
+}
+
+ssize_t MmapSource::read(char* buffer, size_t size) {
+    size = static_cast<size_t>(std::min<uint64_t>(size, length_ - position_));
+    if (size == 0) {
+        return 0;
+    }
+    
+    memcpy(buffer, base_ + delta_ + position_, size);
+    position_ += size;
+    if (cache_) {
+        // Mapped pages stay cached, so give up the ones already read
+        size_t done = static_cast<size_t>((delta_ + position_) & ~(PAGE_CACHE_STEP - 1));
+        if (done > released_) {
+            madvise(base_ + released_, done - released_, MADV_DONTNEED);
+            released_ = done;
+        }
+        cache_->advance(offset_ + position_);
+    }
+    return static_cast<ssize_t>(size);
+}
+
+bool MmapSource::skip(uint64_t bytes) {
+    if (bytes > length_ - position_) {
+        return false;
+    }
+    position_ += bytes;
+    return true;
+}
+
+void MmapSource::readahead(uint64_t bytes) {
+    bytes = std::min<uint64_t>(bytes, length_ - position_);
+    if (bytes == 0) {
+        return;
+    }
+    
+    uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t start = (delta_ + position_) & ~(pageSize - 1);
+    uint64_t end = delta_ + position_ + bytes;
+    madvise(base_ + start, static_cast<size_t>(end - start), MADV_WILLNEED);
+}
+
+// InflateSource
+
+InflateSource::InflateSource(std::unique_ptr<ByteSource> upstream, int windowBits, uint64_t outputSize)
+    : upstream_(std::move(upstream))
+    , initialized_(false)
+    , finished_(false)
+    , outputSize_(outputSize)
+    , position_(0)
+    , input_(INFLATE_INPUT_BUFFER_SIZE)
+{
+    memset(&stream_, 0, sizeof(stream_));
+    
+    if (inflateInit2(&stream_, windowBits) != Z_OK) {
+        Log::error(TAG, "inflateInit2 failed");
+        return;
+    }
+    initialized_ = true;
+}
+
+InflateSource::~InflateSource() {
+    if (initialized_) {
+        inflateEnd(&stream_);
+    }
+}
+
+ssize_t InflateSource::read(char* buffer, size_t size) {
+    if (!initialized_) {
+        return -1;
+    }
+    if (finished_ || size == 0) {
+        return 0;
+    }
+    
+    uInt requested = static_cast<uInt>(std::min(size, INFLATE_MAX_OUTPUT));
+    stream_.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream_.avail_out = requested;
+    
+    while (stream_.avail_out == requested) {
+        if (stream_.avail_in == 0) {
+            ssize_t bytesRead = upstream_->read(reinterpret_cast<char*>(input_.data()), input_.size());
+            if (bytesRead < 0) {
+                return -1;
+            }
+            if (bytesRead == 0) {
+                Log::error(TAG, "Truncated compressed stream");
+                return -1;
+            }
+            stream_.next_in = input_.data();
+            stream_.avail_in = static_cast<uInt>(bytesRead);
+        }
+        
+        int result = inflate(&stream_, Z_NO_FLUSH);
+        if (result == Z_STREAM_END) {
+            finished_ = true;
+            break;
+        }
+        if (result != Z_OK) {
+            Log::error(TAG, "Inflate failed (" + std::to_string(result) + ")");
+            return -1;
+        }
+    }
+    
+    size_t produced = requested - stream_.avail_out;
+    position_ += produced;
+    
+    if (finished_ && outputSize_ != BYTE_SOURCE_UNKNOWN_SIZE && position_ != outputSize_) {
+        Log::error(TAG, "Stream length differs from declared size");
+        return -1;
+    }
+    
+    return static_cast<ssize_t>(produced);
+}
+
+// GzipSource
+
+GzipSource::GzipSource(std::unique_ptr<ByteSource> upstream)
+    : InflateSource(std::move(upstream), MAX_WBITS + 32)
+{
+}
+
+// TarEntrySource
+
+TarEntrySource::TarEntrySource(std::unique_ptr<ByteSource> upstream, uint64_t offset, uint64_t length)
+    : upstream_(std::move(upstream))
+    , offset_(offset)
+    , length_(length)
+    , position_(0)
+{
+}
+
+bool TarEntrySource::open() {
+    uint64_t current = upstream_->position();
+    if (current > offset_ || !upstream_->skip(offset_ - current)) {
+        Log::error(TAG, "Entry offset " + std::to_string(offset_) + " not reachable");
+        return false;
+    }
+    return true;
+}
+
+ssize_t TarEntrySource::read(char* buffer, size_t size) {
+    size = static_cast<size_t>(std::min<uint64_t>(size, length_ - position_));
+    if (size == 0) {
+        return 0;
+    }
+    
+    ssize_t bytesRead = upstream_->read(buffer, size);
+    if (bytesRead < 0) {
+        return -1;
+    }
+    if (bytesRead == 0) {
+        Log::error(TAG, "Entry truncated at " + std::to_string(position_) + " of " +
+                   std::to_string(length_) + " bytes");
+        return -1;
+    }
+    
+    position_ += static_cast<uint64_t>(bytesRead);
+    return bytesRead;
+}
+
+bool TarEntrySource::skip(uint64_t bytes) {
+    if (bytes > length_ - position_ || !upstream_->skip(bytes)) {
+        return false;
+    }
+    position_ += bytes;
+    return true;
+}
+
+void TarEntrySource::readahead(uint64_t bytes) {
+    upstream_->readahead(std::min<uint64_t>(bytes, length_ - position_));
+}
+
+// ReplaySource
+
+ReplaySource::ReplaySource(const char* head, size_t headSize, std::unique_ptr<ByteSource> rest)
+    : head_(head, headSize)
+    , rest_(std::move(rest))
+    , position_(0)
+{
+}
+
+ssize_t ReplaySource::read(char* buffer, size_t size) {
+    if (position_ < head_.size()) {
+        size_t count = std::min(size, head_.size() - static_cast<size_t>(position_));
+        memcpy(buffer, head_.data() + position_, count);
+        position_ += count;
+        return static_cast<ssize_t>(count);
+    }
+    
+    ssize_t bytesRead = rest_->read(buffer, size);
+    if (bytesRead > 0) {
+        position_ += static_cast<uint64_t>(bytesRead);
+    }
+    return bytesRead;
+}
+
+uint64_t ReplaySource::size() const {
+    uint64_t rest = rest_->size();
+    return rest == BYTE_SOURCE_UNKNOWN_SIZE ? rest : head_.size() + rest - rest_->position();
+}
+
+// Lz4FrameSource
+
+constexpr uint32_t LZ4_SKIPPABLE_MAGIC_MASK = 0xFFFFFFF0;
+constexpr uint32_t LZ4_SKIPPABLE_MAGIC = 0x184D2A50;
+constexpr uint32_t LZ4_BLOCK_UNCOMPRESSED = 0x80000000;
+
+Lz4FrameSource::Lz4FrameSource(std::unique_ptr<ByteSource> upstream)
+    : upstream_(std::move(upstream))
+    , state_(State::Magic)
+    , failed_(false)
+    , fieldFill_(0)
+    , fieldNeed_(4)
+    , remaining_(0)
+    , blockChecksum_(false)
+    , contentChecksum_(false)
+    , maxBlockSize_(0)
+    , frames_(0)
+{
+    memset(field_, 0, sizeof(field_));
+}
+
+ssize_t Lz4FrameSource::read(char* buffer, size_t size) {
+    if (failed_) {
+        return -1;
+    }
+    
+    ssize_t bytesRead = upstream_->read(buffer, size);
+    if (bytesRead < 0) {
+        failed_ = true;
+        return -1;
+    }
+    
+    if (bytesRead == 0) {
+        // Only a frame boundary is a valid place to stop
+        if (state_ != State::Magic || fieldFill_ != 0 || frames_ == 0) {
+            Log::error(TAG, "Truncated LZ4 frame");
+            failed_ = true;
+            return -1;
+        }
+        return 0;
+    }
+    
+    if (!consume(reinterpret_cast<const unsigned char*>(buffer), static_cast<size_t>(bytesRead))) {
+        failed_ = true;
+        return -1;
+    }
+    
+    return bytesRead;
+}
+
+bool Lz4FrameSource::consume(const unsigned char* data, size_t size) {
+    while (size > 0) {
+        if (state_ == State::BlockData || state_ == State::SkippableData) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining_, size));
+            remaining_ -= chunk;
+            data += chunk;
+            size -= chunk;
+            
+            if (remaining_ == 0) {
+                state_ = (state_ == State::BlockData) ? State::BlockSize : State::Magic;
+                fieldNeed_ = 4;
+            }
+            continue;
+        }
+        
+        // Fixed-size fields may straddle reads
+        size_t chunk = std::min(fieldNeed_ - fieldFill_, size);
+        memcpy(field_ + fieldFill_, data, chunk);
+        fieldFill_ += chunk;
+        data += chunk;
+        size -= chunk;
+        
+        if (fieldFill_ == fieldNeed_ && !completeField()) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+bool Lz4FrameSource::completeField() {
+    uint32_t value = readLE32(field_);
+    
+    switch (state_) {
+        case State::Magic:
+            fieldFill_ = 0;
+            if (value == LZ4_MAGIC) {
+                state_ = State::Header;
+                fieldNeed_ = 2;
+            } else if ((value & LZ4_SKIPPABLE_MAGIC_MASK) == LZ4_SKIPPABLE_MAGIC) {
+                state_ = State::SkippableSize;
+                fieldNeed_ = 4;
+            } else {
+                Log::error(TAG, "Invalid LZ4 frame magic");
+                return false;
+            }
+            return true;
+        
+        case State::Header:
+            if (fieldNeed_ == 2) {
+                // FLG and BD known, the rest of the descriptor follows
+                uint8_t flg = field_[0];
+                uint8_t bd = field_[1];
+                uint8_t blockSizeId = (bd >> 4) & 0x07;
+                
+                if ((flg >> 6) != 0x01 || blockSizeId < 4) {
+                    Log::error(TAG, "Unsupported LZ4 frame descriptor");
+                    return false;
+                }
+                
+                blockChecksum_ = (flg & 0x10) != 0;
+                contentChecksum_ = (flg & 0x04) != 0;
+                maxBlockSize_ = 1u << (8 + 2 * blockSizeId);
+                fieldNeed_ = 2 + ((flg & 0x08) ? 8 : 0) + ((flg & 0x01) ? 4 : 0) + 1;
+                return true;
+            }
+            fieldFill_ = 0;
+            fieldNeed_ = 4;
+            state_ = State::BlockSize;
+            return true;
+        
+        case State::BlockSize:
+            fieldFill_ = 0;
+            if (value == 0) {
+                // EndMark
+                if (contentChecksum_) {
+                    state_ = State::ContentChecksum;
+                } else {
+                    frames_++;
+                    state_ = State::Magic;
+                }
+                fieldNeed_ = 4;
+                return true;
+            }
+            
+            if ((value & ~LZ4_BLOCK_UNCOMPRESSED) > maxBlockSize_) {
+                Log::error(TAG, "LZ4 block larger than frame maximum");
+                return false;
+            }
+            remaining_ = (value & ~LZ4_BLOCK_UNCOMPRESSED) + (blockChecksum_ ? 4 : 0);
+            state_ = State::BlockData;
+            return true;
+        
+        case State::ContentChecksum:
+            fieldFill_ = 0;
+            fieldNeed_ = 4;
+            frames_++;
+            state_ = State::Magic;
+            return true;
+        
+        case State::SkippableSize:
+            fieldFill_ = 0;
+            fieldNeed_ = 4;
+            remaining_ = value;
+            state_ = (remaining_ > 0) ? State::SkippableData : State::Magic;
+            return true;
+        
+        default:
+            return false;
+    }
+}
+
+std::unique_ptr<ByteSource> openSourceChain(const std::string& path,
+                                            const std::vector<SourceStage>& stages,
+                                            ReadMode mode, PageCache::Reader* cache) {
+    std::unique_ptr<ByteSource> source;
+    
+    for (const auto& stage : stages) {
+        switch (stage.kind) {
+            case SourceStageKind::ZipMember:
+                // The central directory needs random access to the archive
+                if (source) {
+                    Log::error(ByteSource::TAG, "ZIP archives are only read as the outermost container");
+                    return nullptr;
+                }
+                source = ZipMemberSource::open(path, stage.name, mode, cache);
+                break;
+            
+            case SourceStageKind::Gzip: {
+                if (!source) {
+                    source = ByteSource::openFile(path, mode, 0, BYTE_SOURCE_UNKNOWN_SIZE, cache);
+                    if (!source) {
+                        return nullptr;
+                    }
+                }
+                std::unique_ptr<GzipSource> gzip(new GzipSource(std::move(source)));
+                if (gzip->isValid()) {
+                    source = std::move(gzip);
+                }
+                break;
+            }
+        }
+        
+        if (!source) {
+            return nullptr;
+        }
+    }
+    
+    if (!source) {
+        source = ByteSource::openFile(path, mode, 0, BYTE_SOURCE_UNKNOWN_SIZE, cache);
+    }
+    
+    return source;
+}
+
+} // namespace Odin
@@ -0,0 +1,71 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * CacheDirectory - Per-user cache directory handling
+ */
+
+#include "CacheDirectory.h"
+#include "Digest.h"
+#include "Log.h"
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Odin {
+
+static const std::string TAG = "CacheDirectory";
+
+std::string cacheDirectory(const std::string& name) {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0] != '\0') {
+        return std::string(xdg) + "/odin4/" + name;
+    }
+    
+    const char* home = getenv("HOME");
+    if (home && home[0] != '\0') {
+        return std::string(home) + "/.cache/odin4/" + name;
+    }
+    
+    return "";
+}
+
+bool privateCacheDirectory(const std::string& directory, bool create) {
+    if (directory.empty()) {
+        return false;
+    }
+    
+    if (create) {
+        // mkdir -p
+        std::string partial;
+        size_t pos = 0;
+        while (pos != std::string::npos) {
+            pos = directory.find('/', pos + 1);
+            partial = directory.substr(0, pos);
+            if (mkdir(partial.c_str(), 0700) != 0 && errno != EEXIST) {
+                Log::error(TAG, "Cannot create cache directory: " + partial);
+                return false;
+            }
+        }
+    }
+    
+    // A directory others can write to may hold entries they planted
+    struct stat st;
+    if (lstat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return false;
+    }
+    if (st.st_uid != geteuid() || (st.st_mode & 077) != 0) {
+        Log::error(TAG, "Cache directory is not private to this user, not using it: " + directory);
+        return false;
+    }
+    
+    return true;
+}
+
+std::string cacheFilePath(const std::string& directory, std::string_view key, const char* suffix) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(fnv1a(key)));
+    return directory + "/" + name + suffix;
+}
+
+} // namespace Odin
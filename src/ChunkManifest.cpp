@@ -0,0 +1,229 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * ChunkManifest - Chunk manifest implementation
+ */
+
+#include "ChunkManifest.h"
+#include "HashService.h"
+#include "Manifest.h"
+#include "Sha256Engine.h"
+#include "Log.h"
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace Odin {
+
+const std::string ChunkManifest::TAG = "ChunkManifest";
+
+// Chunks per entry, protects against a size that is garbage
+constexpr uint64_t CHUNK_MANIFEST_MAX_COUNT = 1 << 24;
+
+ChunkManifest::ChunkManifest(uint64_t chunkSize)
+    : chunkSize_(chunkSize)
+{
+}
+
+std::string ChunkManifest::sidecarPath(const std::string& path) {
+    return path + ".chunks";
+}
+
+Digest ChunkManifest::merkleRoot(const std::vector<Digest>& leaves) {
+    if (leaves.empty()) {
+        return Sha256().final();
+    }
+    
+    std::vector<Digest> level = leaves;
+    while (level.size() > 1) {
+        std::vector<Digest> parents;
+        parents.reserve((level.size() + 1) / 2);
+        
+        for (size_t i = 0; i + 1 < level.size(); i += 2) {
+            const char node = 0x01;
+            Sha256 hash;
+            hash.update(&node, 1);
+            hash.update(reinterpret_cast<const char*>(level[i].data()), level[i].size());
+            hash.update(reinterpret_cast<const char*>(level[i + 1].data()), level[i + 1].size());
+            parents.push_back(hash.final());
+        }
+        if (level.size() % 2 != 0) {
+            parents.push_back(level.back());
+        }
+        level.swap(parents);
+    }
+    
+    return level.front();
+}
+
+bool ChunkManifest::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    std::string line;
+    if (!std::getline(file, line)) {
+        return false;
+    }
+    
+    char magic[16] = {0};
+    unsigned version = 0;
+    unsigned long long chunkSize = 0;
+    if (sscanf(line.c_str(), "%15s %u %llu", magic, &version, &chunkSize) != 3 ||
+        strcmp(magic, "odin4-chunks") != 0 || version != 1 ||
+        chunkSize < CHUNK_MANIFEST_MIN_CHUNK || chunkSize > CHUNK_MANIFEST_MAX_CHUNK) {
+        Log::error(TAG, "Not a chunk manifest: " + path);
+        return false;
+    }
+    chunkSize_ = chunkSize;
+    
+    std::vector<std::shared_ptr<const ChunkedEntry>> entries;
+    std::unordered_map<std::string, size_t> byName;
+    
+    while (std::getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        
+        // <root> <size> <name>
+        auto entry = std::make_shared<ChunkedEntry>();
+        size_t sizeStart = line.find(' ');
+        size_t nameStart = sizeStart == std::string::npos ? sizeStart : line.find(' ', sizeStart + 1);
+        if (nameStart == std::string::npos) {
+            Log::error(TAG, "Malformed entry in " + path);
+            return false;
+        }
+        entry->root = Digest::fromHex(std::string_view(line).substr(0, sizeStart));
+        entry->size = strtoull(line.c_str() + sizeStart + 1, nullptr, 10);
+        entry->chunkSize = chunkSize_;
+        entry->name = line.substr(nameStart + 1);
+        
+        uint64_t count = (entry->size + chunkSize_ - 1) / chunkSize_;
+        if (count > CHUNK_MANIFEST_MAX_COUNT) {
+            Log::error(TAG, "Malformed entry in " + path);
+            return false;
+        }
+        entry->chunks.reserve(static_cast<size_t>(count));
+        for (uint64_t i = 0; i < count; i++) {
+            if (!std::getline(file, line)) {
+                break;
+            }
+            entry->chunks.push_back(Digest::fromHex(line));
+            if (entry->chunks.back().size() != SHA256_DIGEST_SIZE) {
+                break;
+            }
+        }
+        
+        // Also catches a damaged or edited chunk line
+        if (entry->chunks.size() != count || entry->root.size() != SHA256_DIGEST_SIZE ||
+            merkleRoot(entry->chunks) != entry->root) {
+            Log::error(TAG, "Inconsistent entry " + entry->name + " in " + path);
+            return false;
+        }
+        
+        byName[entry->name] = entries.size();
+        entries.push_back(entry);
+    }
+    
+    entries_ = std::move(entries);
+    byName_ = std::move(byName);
+    return true;
+}
+
+bool ChunkManifest::save(const std::string& path) const {
+    // Write to a temporary file and rename so a concurrent load() never
+    // sees a half-written manifest
+    std::string tempPath = path + ".tmp" + std::to_string(getpid());
+    std::ofstream out(tempPath, std::ios::trunc);
+    if (!out.is_open()) {
+        Log::error(TAG, "Cannot write: " + tempPath);
+        return false;
+    }
+    
+    out << "odin4-chunks 1 " << chunkSize_ << '\n';
+    for (const auto& entry : entries_) {
+        out << entry->root.hex() << ' ' << entry->size << ' ' << entry->name << '\n';
+        for (const auto& chunk : entry->chunks) {
+            out << chunk.hex() << '\n';
+        }
+    }
+    
+    out.close();
+    if (!out || rename(tempPath.c_str(), path.c_str()) != 0) {
+        Log::error(TAG, "Failed to write: " + path);
+        unlink(tempPath.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+bool ChunkManifest::add(const std::string& name, const std::string& path, uint64_t offset, uint64_t size) {
+    auto entry = std::make_shared<ChunkedEntry>();
+    entry->name = name;
+    entry->size = size;
+    entry->chunkSize = chunkSize_;
+    
+    std::vector<HashJob> jobs;
+    for (uint64_t chunk = 0; chunk < size; chunk += chunkSize_) {
+        jobs.emplace_back(path, HashAlgorithm::SHA256, offset + chunk, std::min(chunkSize_, size - chunk));
+    }
+    
+    std::vector<std::future<std::string>> digests = HashService::instance().submit(jobs);
+    for (auto& digest : digests) {
+        entry->chunks.push_back(Digest::fromHex(digest.get()));
+        if (entry->chunks.back().empty()) {
+            Log::error(TAG, "Failed to hash: " + name);
+            return false;
+        }
+    }
+    entry->root = merkleRoot(entry->chunks);
+    
+    auto it = byName_.find(name);
+    if (it != byName_.end()) {
+        entries_[it->second] = entry;
+    } else {
+        byName_[name] = entries_.size();
+        entries_.push_back(entry);
+    }
+    return true;
+}
+
+std::shared_ptr<const ChunkedEntry> ChunkManifest::find(const std::string& name) const {
+    auto it = byName_.find(name);
+    return it != byName_.end() ? entries_[it->second] : nullptr;
+}
+
+std::vector<std::shared_future<std::string>> ChunkManifest::submitVerify(const ChunkedEntry& entry,
+                                                                         const std::string& path, uint64_t offset) {
+    std::vector<std::shared_future<std::string>> digests;
+    digests.reserve(entry.chunks.size());
+    for (size_t i = 0; i < entry.chunks.size(); i++) {
+        HashJob job(path, HashAlgorithm::SHA256, offset + entry.chunkOffset(i), entry.chunkLength(i));
+        digests.push_back(HashService::instance().submit(job).share());
+    }
+    return digests;
+}
+
+bool ChunkManifest::checkVerify(const ChunkedEntry& entry, const std::vector<std::shared_future<std::string>>& digests,
+                                std::vector<size_t>* badChunks) {
+    bool match = digests.size() == entry.chunks.size();
+    for (size_t i = 0; i < digests.size() && i < entry.chunks.size(); i++) {
+        if (Digest::fromHex(digests[i].get()) != entry.chunks[i]) {
+            match = false;
+            if (badChunks) {
+                badChunks->push_back(i);
+            }
+        }
+    }
+    return match;
+}
+
+bool ChunkManifest::verify(const ChunkedEntry& entry, const std::string& path, uint64_t offset,
+                           std::vector<size_t>* badChunks) {
+    return checkVerify(entry, submitVerify(entry, path, offset), badChunks);
+}
+
+} // namespace Odin
@@ -0,0 +1,132 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * DeviceProfile - Device info parsing
+ */
+
+#include "DeviceProfile.h"
+#include "FirmwareInfo.h"
+#include "Log.h"
+#include <cstring>
+
+namespace Odin {
+
+const std::string DeviceProfile::TAG = "DeviceProfile";
+
+// Block header and item records
+constexpr size_t DEVINFO_HEADER_SIZE = 8;
+constexpr size_t DEVINFO_ITEM_SIZE = 12;
+
+static uint32_t readU32(const char* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static const char* storageName(PITDeviceType type) {
+    switch (type) {
+        case PITDeviceType::OneNAND: return "OneNAND";
+        case PITDeviceType::NAND: return "NAND";
+        case PITDeviceType::MMC: return "MMC";
+        case PITDeviceType::UFS: return "UFS";
+        default: return "unknown";
+    }
+}
+
+bool DeviceProfile::parseDeviceInfo(const char* data, size_t size) {
+    if (size < DEVINFO_HEADER_SIZE || readU32(data) != DEVINFO_MAGIC) {
+        return false;
+    }
+    
+    uint32_t count = readU32(data + 4);
+    if (count > (size - DEVINFO_HEADER_SIZE) / DEVINFO_ITEM_SIZE) {
+        return false;
+    }
+    
+    // Every item has to lie inside the block before any is used
+    for (uint32_t i = 0; i < count; i++) {
+        const char* item = data + DEVINFO_HEADER_SIZE + i * DEVINFO_ITEM_SIZE;
+        uint64_t offset = readU32(item + 4);
+        uint64_t length = readU32(item + 8);
+        if (offset + length > size) {
+            return false;
+        }
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        const char* item = data + DEVINFO_HEADER_SIZE + i * DEVINFO_ITEM_SIZE;
+        uint32_t type = readU32(item);
+        const char* value = data + readU32(item + 4);
+        size_t length = readU32(item + 8);
+        
+        // Strings may carry their terminator and padding
+        std::string text(value, strnlen(value, length));
+        uint32_t number = length >= 4 ? readU32(value) : 0;
+        bool isNumber = length >= 4;
+        
+        switch (static_cast<DeviceInfoItem>(type)) {
+            case DeviceInfoItem::Model:
+                model = text;
+                break;
+            case DeviceInfoItem::Serial:
+                serial = text;
+                break;
+            case DeviceInfoItem::Region:
+                region = text;
+                break;
+            case DeviceInfoItem::Carrier:
+                carrier = text;
+                break;
+            case DeviceInfoItem::MaxPacketSize:
+                if (isNumber) {
+                    maxPacketSize = number;
+                }
+                break;
+            case DeviceInfoItem::CompressedDownload:
+                if (isNumber) {
+                    compressedDownload = number != 0;
+                    compressedReported = true;
+                }
+                break;
+            case DeviceInfoItem::MaxSequenceSize:
+                if (isNumber) {
+                    maxSequenceSize = number;
+                }
+                break;
+            case DeviceInfoItem::StorageType:
+                if (isNumber) {
+                    storage = static_cast<PITDeviceType>(number);
+                    storageReported = true;
+                }
+                break;
+            case DeviceInfoItem::ZeroLengthPackets:
+                if (isNumber) {
+                    zeroLengthPackets = number != 0;
+                }
+                break;
+            default:
+                Log::debug(TAG, "Skipping device info item " + std::to_string(type));
+                break;
+        }
+    }
+    
+    fromDeviceInfo = true;
+    return true;
+}
+
+void DeviceProfile::print() const {
+    if (!model.empty()) {
+        Log::info(TAG, "Model: " + model + (region.empty() ? "" : ", region " + region) +
+                  (carrier.empty() ? "" : ", carrier " + carrier));
+    }
+    
+    Log::info(TAG, std::string("Device profile: ") + (fromDeviceInfo ? "reported" : "inferred") +
+              ", protocol " + std::to_string(protocolVersion) +
+              ", max packet " + (maxPacketSize ? std::to_string(maxPacketSize) : std::string("unknown")) +
+              ", max transfer " + (maxSequenceSize ? std::to_string(maxSequenceSize) : std::string("unknown")) +
+              ", storage " + (storageReported ? storageName(storage) : "unknown") +
+              ", compressed download " + (compressedReported ? (compressedDownload ? "yes" : "no") : "unknown") +
+              ", ZLP " + (zeroLengthPackets ? "yes" : "no") +
+              (systemLSI ? ", SystemLSI" : ""));
+}
+
+} // namespace Odin
@@ -0,0 +1,82 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * Digest - Digest map implementation
+ */
+
+#include "Digest.h"
+#include <utility>
+
+namespace Odin {
+
+constexpr size_t DIGEST_MAP_INITIAL_SLOTS = 16;
+
+DigestMap::DigestMap()
+    : slots_(DIGEST_MAP_INITIAL_SLOTS)
+    , count_(0)
+{
+}
+
+uint64_t fnv1a(std::string_view data) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+size_t DigestMap::probe(std::string_view name, uint64_t hash) const {
+    // The table is never full, so this finds the name or a free slot
+    size_t mask = slots_.size() - 1;
+    size_t index = static_cast<size_t>(hash) & mask;
+    
+    while (slots_[index].used && (slots_[index].hash != hash || slots_[index].name != name)) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+void DigestMap::insert(const std::string& name, const Digest& digest) {
+    if (2 * (count_ + 1) > slots_.size()) {
+        grow();
+    }
+    
+    uint64_t hash = fnv1a(name);
+    Slot& slot = slots_[probe(name, hash)];
+    if (!slot.used) {
+        slot.name = name;
+        slot.hash = hash;
+        slot.used = true;
+        count_++;
+    }
+    slot.digest = digest;
+}
+
+const Digest* DigestMap::find(std::string_view name) const {
+    const Slot& slot = slots_[probe(name, fnv1a(name))];
+    return slot.used ? &slot.digest : nullptr;
+}
+
+void DigestMap::clear() {
+    slots_.assign(DIGEST_MAP_INITIAL_SLOTS, Slot());
+    count_ = 0;
+}
+
+void DigestMap::grow() {
+    std::vector<Slot> old(slots_.size() * 2);
+    old.swap(slots_);
+    
+    size_t mask = slots_.size() - 1;
+    for (auto& slot : old) {
+        if (!slot.used) {
+            continue;
+        }
+        size_t index = static_cast<size_t>(slot.hash) & mask;
+        while (slots_[index].used) {
+            index = (index + 1) & mask;
+        }
+        slots_[index] = std::move(slot);
+    }
+}
+
+} // namespace Odin
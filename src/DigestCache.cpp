@@ -0,0 +1,191 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * DigestCache - Whole-file digest cache implementation
+ */
+
+#include "DigestCache.h"
+#include "CacheDirectory.h"
+#include "Log.h"
+#include <fstream>
+#include <cstdio>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+namespace Odin {
+
+const std::string DigestCache::TAG = "DigestCache";
+
+// Store file layout (text):
+// ODINDGST 1
+// <canonical path>
+// <inode> <size> <mtime ns>
+// md5 <hex>
+// sha256 <hex>
+static const char DIGEST_STORE_MAGIC[] = "ODINDGST 1";
+
+static const char* attributeName(HashAlgorithm algorithm) {
+    return algorithm == HashAlgorithm::SHA256 ? "user.odin4.sha256" : "user.odin4.md5";
+}
+
+static const char* algorithmName(HashAlgorithm algorithm) {
+    return algorithm == HashAlgorithm::SHA256 ? "sha256" : "md5";
+}
+
+// "<inode> <size> <mtime ns>", the part of FileIdentity a digest is bound to
+static std::string identityKey(const FileIdentity& identity) {
+    return std::to_string(identity.inode) + " " + std::to_string(identity.size) + " " +
+           std::to_string(identity.mtimeNs);
+}
+
+static bool isHexDigest(const std::string& value, HashAlgorithm algorithm) {
+    size_t length = algorithm == HashAlgorithm::SHA256 ? 64 : 32;
+    if (value.size() != length) {
+        return false;
+    }
+    for (char c : value) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static ssize_t readAttribute(const std::string& path, const char* name, char* buffer, size_t size) {
+#ifdef __APPLE__
+    return getxattr(path.c_str(), name, buffer, size, 0, 0);
+#else
+    return getxattr(path.c_str(), name, buffer, size);
+#endif
+}
+
+static bool writeAttribute(const std::string& path, const char* name, const std::string& value) {
+#ifdef __APPLE__
+    return setxattr(path.c_str(), name, value.data(), value.size(), 0, 0) == 0;
+#else
+    return setxattr(path.c_str(), name, value.data(), value.size(), 0) == 0;
+#endif
+}
+
+DigestCache& DigestCache::instance() {
+    static DigestCache cache;
+    return cache;
+}
+
+DigestCache::DigestCache()
+    : directory_(defaultDirectory())
+    , enabled_(true)
+{
+}
+
+std::string DigestCache::defaultDirectory() {
+    return cacheDirectory("digests");
+}
+
+bool DigestCache::lookup(const FileIdentity& identity, HashAlgorithm algorithm, std::string& digest) const {
+    if (!enabled_) {
+        return false;
+    }
+    
+    // "<inode> <size> <mtime ns> <hex>", at most 20 + 20 + 20 + 64 + 3 bytes
+    char value[160];
+    ssize_t length = readAttribute(identity.path, attributeName(algorithm), value, sizeof(value));
+    if (length > 0) {
+        std::string text(value, static_cast<size_t>(length));
+        std::string key = identityKey(identity) + " ";
+        if (text.compare(0, key.size(), key) == 0 && isHexDigest(text.substr(key.size()), algorithm)) {
+            digest = text.substr(key.size());
+            return true;
+        }
+    }
+    
+    return lookupStore(identity, algorithm, digest);
+}
+
+void DigestCache::store(const FileIdentity& identity, HashAlgorithm algorithm, const std::string& digest) const {
+    if (!enabled_ || !isHexDigest(digest, algorithm)) {
+        return;
+    }
+    
+    // Read-only media, foreign files and file systems without user
+    // attributes (tmpfs on older kernels, some network mounts) use the store
+    if (writeAttribute(identity.path, attributeName(algorithm), identityKey(identity) + " " + digest)) {
+        return;
+    }
+    
+    if (!writeStore(identity, algorithm, digest)) {
+        Log::debug(TAG, "Digest not cached: " + identity.path);
+    }
+}
+
+std::string DigestCache::storePath(const std::string& canonicalPath) const {
+    // The path is stored in the file and compared on load
+    return cacheFilePath(directory_, canonicalPath, ".dgst");
+}
+
+bool DigestCache::lookupStore(const FileIdentity& identity, HashAlgorithm algorithm, std::string& digest) const {
+    if (!privateCacheDirectory(directory_, false)) {
+        return false;
+    }
+    
+    std::ifstream in(storePath(identity.path));
+    if (!in.is_open()) {
+        return false;
+    }
+    
+    std::string magic, path, key, line;
+    if (!std::getline(in, magic) || magic != DIGEST_STORE_MAGIC ||
+        !std::getline(in, path) || path != identity.path ||
+        !std::getline(in, key) || key != identityKey(identity)) {
+        return false;
+    }
+    
+    std::string prefix = std::string(algorithmName(algorithm)) + " ";
+    while (std::getline(in, line)) {
+        if (line.compare(0, prefix.size(), prefix) == 0 && isHexDigest(line.substr(prefix.size()), algorithm)) {
+            digest = line.substr(prefix.size());
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool DigestCache::writeStore(const FileIdentity& identity, HashAlgorithm algorithm, const std::string& digest) const {
+    if (!privateCacheDirectory(directory_, true)) {
+        return false;
+    }
+    
+    // Keep the other algorithm's digest if it is for the same file
+    HashAlgorithm other = algorithm == HashAlgorithm::SHA256 ? HashAlgorithm::MD5 : HashAlgorithm::SHA256;
+    std::string otherDigest;
+    bool keepOther = lookupStore(identity, other, otherDigest);
+    
+    // Write to a temporary file and rename, concurrent runs and hash
+    // workers may store digests of the same file
+    static std::atomic<unsigned> sequence(0);
+    std::string finalPath = storePath(identity.path);
+    std::string tempPath = finalPath + ".tmp" + std::to_string(getpid()) + "." + std::to_string(sequence++);
+    
+    std::ofstream out(tempPath, std::ios::trunc);
+    if (!out.is_open()) {
+        return false;
+    }
+    
+    out << DIGEST_STORE_MAGIC << '\n'
+        << identity.path << '\n'
+        << identityKey(identity) << '\n'
+        << algorithmName(algorithm) << ' ' << digest << '\n';
+    if (keepOther) {
+        out << algorithmName(other) << ' ' << otherDigest << '\n';
+    }
+    
+    out.close();
+    if (!out || rename(tempPath.c_str(), finalPath.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+} // namespace Odin
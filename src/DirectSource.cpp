@@ -0,0 +1,212 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * DirectSource - Direct I/O file stage implementation
+ */
+
+#include "DirectSource.h"
+#include "Log.h"
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Odin {
+
+const std::string DirectSource::TAG = "DirectSource";
+
+// Covers the logical block size of any common disk (512 or 4096)
+constexpr uint64_t DIRECT_IO_ALIGNMENT = 4096;
+
+// Bytes per direct read and per pooled buffer
+constexpr size_t DIRECT_READ_SIZE = 0x400000;  // 4MB
+
+// Free buffers the pool keeps for the next payload
+constexpr size_t DIRECT_POOL_KEEP = 8;
+
+namespace {
+
+// Aligned buffers recycled across payloads and devices, so a run does
+// not allocate and fault in a fresh buffer for every file
+class AlignedBufferPool {
+public:
+    static AlignedBufferPool& instance() {
+        static AlignedBufferPool pool;
+        return pool;
+    }
+    
+    char* acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                char* buffer = free_.back();
+                free_.pop_back();
+                return buffer;
+            }
+        }
+        
+        void* memory = nullptr;
+        if (posix_memalign(&memory, DIRECT_IO_ALIGNMENT, DIRECT_READ_SIZE) != 0) {
+            return nullptr;
+        }
+        return static_cast<char*>(memory);
+    }
+    
+    void release(char* buffer) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.size() < DIRECT_POOL_KEEP) {
+            free_.push_back(buffer);
+        } else {
+            free(buffer);
+        }
+    }
+    
+    ~AlignedBufferPool() {
+        for (char* buffer : free_) {
+            free(buffer);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<char*> free_;
+};
+
+bool setDirect(int fd, bool enable) {
+#if defined(O_DIRECT)
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) {
+        return false;
+    }
+    flags = enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return fcntl(fd, F_SETFL, flags) == 0;
+#elif defined(F_NOCACHE)
+    return fcntl(fd, F_NOCACHE, enable ? 1 : 0) == 0;
+#else
+    (void)fd;
+    return !enable;
+#endif
+}
+
+bool isAligned(uint64_t value) {
+    return (value & (DIRECT_IO_ALIGNMENT - 1)) == 0;
+}
+
+} // namespace
+
+std::unique_ptr<DirectSource> DirectSource::open(int fd, uint64_t offset, uint64_t length) {
+    if (!setDirect(fd, true)) {
+        return nullptr;
+    }
+    
+    std::unique_ptr<DirectSource> source(new DirectSource(fd, offset, length));
+    
+    // Some file systems accept the flag and only refuse the reads
+    if (!source->buffer_ || !source->fill()) {
+        setDirect(fd, false);
+        source->fd_ = -1;   // The caller keeps the descriptor for its fallback
+        return nullptr;
+    }
+    
+    return source;
+}
+
+DirectSource::DirectSource(int fd, uint64_t offset, uint64_t length)
+    : fd_(fd)
+    , offset_(offset)
+    , length_(length)
+    , position_(0)
+    , buffer_(AlignedBufferPool::instance().acquire())
+    , bufferStart_(0)
+    , bufferFill_(0)
+{
+}
+
+DirectSource::~DirectSource() {
+    if (buffer_) {
+        AlignedBufferPool::instance().release(buffer_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+size_t DirectSource::bufferBytes() const {
+    return DIRECT_READ_SIZE;
+}
+
+bool DirectSource::fill() {
+    uint64_t target = offset_ + position_;
+    uint64_t start = target & ~(DIRECT_IO_ALIGNMENT - 1);
+    
+    ssize_t bytesRead;
+    do {
+        bytesRead = pread(fd_, buffer_, DIRECT_READ_SIZE, static_cast<off_t>(start));
+    } while (bytesRead < 0 && errno == EINTR);
+    
+    if (bytesRead < 0) {
+        Log::debug(TAG, "Direct read failed: " + std::string(strerror(errno)));
+        return false;
+    }
+    if (static_cast<uint64_t>(bytesRead) <= target - start) {
+        Log::error(TAG, "File shorter than expected");
+        return false;
+    }
+    
+    bufferStart_ = start;
+    bufferFill_ = static_cast<size_t>(bytesRead);
+    return true;
+}
+
+ssize_t DirectSource::read(char* buffer, size_t size) {
+    size = static_cast<size_t>(std::min<uint64_t>(size, length_ - position_));
+    if (size == 0) {
+        return 0;
+    }
+    
+    uint64_t target = offset_ + position_;
+    
+    // Whole aligned blocks into an aligned buffer: no bounce copy
+    size_t direct = size & ~static_cast<size_t>(DIRECT_IO_ALIGNMENT - 1);
+    if (direct > 0 && isAligned(target) && isAligned(reinterpret_cast<uintptr_t>(buffer)) &&
+        (target < bufferStart_ || target >= bufferStart_ + bufferFill_)) {
+        ssize_t bytesRead;
+        do {
+            bytesRead = pread(fd_, buffer, direct, static_cast<off_t>(target));
+        } while (bytesRead < 0 && errno == EINTR);
+        
+        if (bytesRead <= 0) {
+            Log::error(TAG, bytesRead < 0 ? "Read failed: " + std::string(strerror(errno))
+                                          : std::string("File shorter than expected"));
+            return -1;
+        }
+        
+        position_ += static_cast<uint64_t>(bytesRead);
+        return bytesRead;
+    }
+    
+    if (target < bufferStart_ || target >= bufferStart_ + bufferFill_) {
+        if (!fill()) {
+            return -1;
+        }
+    }
+    
+    size_t available = bufferFill_ - static_cast<size_t>(target - bufferStart_);
+    size_t count = std::min(size, available);
+    memcpy(buffer, buffer_ + (target - bufferStart_), count);
+    position_ += count;
+    return static_cast<ssize_t>(count);
+}
+
+bool DirectSource::skip(uint64_t bytes) {
+    if (bytes > length_ - position_) {
+        return false;
+    }
+    position_ += bytes;
+    return true;
+}
+
+} // namespace Odin
@@ -4,11 +4,18 @@
  */
 
 #include "DownloadEngine.h"
+#include "MemoryBudget.h"
+#include "Tar.h"
+#include "Manifest.h"
+#include "ChunkManifest.h"
+#include "Sha256Engine.h"
+#include "FirmwareData.h"
 #include "Log.h"
 #include "OdinException.h"
 #include <cstring>
 #include <chrono>
 #include <thread>
+#include <algorithm>
 
 namespace Odin {
 
@@ -17,10 +24,41 @@ const std::string DownloadEngine::TAG = "DownloadEngine";
 // Protocol constants
 constexpr int PACKET_HEADER_SIZE = 0x800;  // 2KB header
 constexpr int DEFAULT_TRANSFER_SIZE = 0x100000;  // 1MB
+constexpr size_t TRANSFER_WINDOW_SIZE = 0x1000000;  // 16MB read per budget lease
+static_assert(2 * CHUNK_MANIFEST_MAX_CHUNK <= TRANSFER_WINDOW_SIZE, "a window half must fit one chunk");
 
-DownloadEngine::DownloadEngine(const std::string& devicePath, FirmwareData* firmware)
+// Check the whole chunks in data, the payload bytes from start on,
+// against the chunk manifest; several chunks are hashed at once
+static bool checkChunks(const ChunkedEntry& entry, uint64_t start, const char* data, size_t size,
+                        const std::string& filename) {
+    std::vector<const unsigned char*> buffers;
+    std::vector<size_t> sizes;
+    size_t first = static_cast<size_t>(start / entry.chunkSize);
+    
+    for (size_t index = first; index < entry.chunks.size() && entry.chunkOffset(index) < start + size; index++) {
+        buffers.push_back(reinterpret_cast<const unsigned char*>(data) + (entry.chunkOffset(index) - start));
+        sizes.push_back(static_cast<size_t>(entry.chunkLength(index)));
+    }
+    
+    std::unique_ptr<unsigned char[][SHA256_DIGEST_SIZE]> digests(new unsigned char[buffers.size()][SHA256_DIGEST_SIZE]);
+    Sha256Engine::digestMany(buffers.data(), sizes.data(), buffers.size(), digests.get());
+    
+    for (size_t i = 0; i < buffers.size(); i++) {
+        if (Digest(digests[i], SHA256_DIGEST_SIZE) != entry.chunks[first + i]) {
+            uint64_t chunkStart = entry.chunkOffset(first + i);
+            Log::error(DownloadEngine::TAG, "Chunk " + std::to_string(first + i) + " of " + filename + " (bytes " +
+                       std::to_string(chunkStart) + "-" + std::to_string(chunkStart + sizes[i] - 1) +
+                       ") does not match the chunk manifest");
+            return false;
+        }
+    }
+    return true;
+}
+
+DownloadEngine::DownloadEngine(const std::string& devicePath,
+                               std::shared_ptr<const FirmwareImage> firmware)
     : device_(nullptr)
-    , firmware_(firmware)
+    , firmware_(std::move(firmware))
     , devicePath_(devicePath)
     , packetSize_(DEFAULT_PACKET_SIZE)
     , hasDeviceInfo_(false)
@@ -32,7 +70,13 @@ DownloadEngine::DownloadEngine(const std::string& devicePath, FirmwareData* firm
     
     if (!device_ || !device_->isValid()) {
         Log::error(TAG, "USB device creation failed");
+        return;
     }
+    
+    // Until the device says otherwise
+    profile_.product = device_->getProduct();
+    profile_.systemLSI = device_->isSystemLSI();
+    profile_.zeroLengthPackets = device_->isSupportedZLP();
 }
 
 DownloadEngine::~DownloadEngine() {
@@ -85,6 +129,7 @@ bool DownloadEngine::initializeConnection() {
     }
     
     Log::info(TAG, "Session result: " + std::to_string(sessionResult));
+    profile_.protocolVersion = sessionResult;
     
     // If device supports packet size change (result != 0)
     if (sessionResult != 0) {
@@ -159,7 +204,7 @@ bool DownloadEngine::getDeviceInfo() {
     }
     
     // Analyze device info
-    if (!deviceInfoAnalysis(infoData.data())) {
+    if (!deviceInfoAnalysis(infoData.data(), static_cast<size_t>(received))) {
         Log::error(TAG, "Failed to analyze device info");
         return false;
     }
@@ -275,6 +320,17 @@ bool DownloadEngine::receivePitInfo() {
     // Parse and display PIT
     Log::info(TAG, "Received " + std::to_string(received) + " bytes of PIT data");
     
+    // Devices of one model usually report identical bytes; they then
+    // share one parsed table and its partition plans
+    devicePit_ = PitCache::instance().acquire(device_->getProduct(), pitData.data(),
+                                              static_cast<size_t>(pitSize));
+    if (!devicePit_) {
+        Log::error(TAG, "Invalid PIT received from device");
+    } else {
+        Log::info(TAG, "Device PIT: " + std::to_string(devicePit_->getPIT().getEntryCount()) +
+                  " partitions, " + devicePit_->getDigest().hex().substr(0, 16));
+    }
+    
     // PIT end (0x65, 3)
     if (!requestAndResponse(static_cast<int>(ProtocolCmd::PIT),
                             static_cast<int>(PITSubCmd::End))) {
@@ -285,8 +341,70 @@ bool DownloadEngine::receivePitInfo() {
     return true;
 }
 
-bool DownloadEngine::transmitData(const std::shared_ptr<char[]>& data, 
-                                   const FirmwareInfo& info) {
+bool DownloadEngine::mapPartitions() {
+    if (!firmware_) {
+        return true;
+    }
+    
+    const PIT& pit = partitionTable();
+    if (pit.getEntryCount() == 0) {
+        Log::error(TAG, "No PIT available for partition mapping");
+        return false;
+    }
+    
+    // The device PIT's plan is resolved once per model and reused
+    std::vector<std::string> unmapped;
+    bool mapped = firmware_->hasPIT() ? firmware_->mapPartitions(pit, targets_, unmapped)
+                                      : devicePit_->mapPartitions(firmware_, targets_, unmapped);
+    if (!mapped) {
+        for (const auto& filename : unmapped) {
+            Log::error(TAG, "No PIT entry for: " + filename);
+        }
+        return false;
+    }
+    
+    return true;
+}
+
+bool DownloadEngine::planTransfers() {
+    if (!firmware_) {
+        return true;
+    }
+    
+    std::vector<std::string> problems;
+    if (!plan_.build(*firmware_, targets_, problems)) {
+        for (const auto& problem : problems) {
+            Log::error(TAG, "Cannot flash: " + problem);
+        }
+        return false;
+    }
+    
+    plan_.print();
+    return true;
+}
+
+const PIT& DownloadEngine::partitionTable() const {
+    // A supplied PIT repartitions the device, so it is authoritative
+    if (firmware_ && firmware_->hasPIT()) {
+        return firmware_->getPIT();
+    }
+    
+    static const PIT none;
+    return devicePit_ ? devicePit_->getPIT() : none;
+}
+
+bool DownloadEngine::transmitData(const FirmwareInfo& info) {
+    
+    std::unique_ptr<ByteSource> source = cursor_->open(info);
+    if (!source) {
+        Log::error(TAG, "Failed to open payload: " + info.filename);
+        return false;
+    }
+    
+    return transmitPayload(info, *source);
+}
+
+bool DownloadEngine::transmitPayload(const FirmwareInfo& info, ByteSource& source) {
     Log::info(TAG, "Transmitting: " + info.filename + 
               " (" + std::to_string(info.size) + " bytes)");
     
@@ -306,14 +424,83 @@ bool DownloadEngine::transmitData(const std::shared_ptr<char[]>& data,
         return false;
     }
     
-    // Transfer data in packets
-    size_t offset = 0;
-    size_t remaining = info.size;
+    // Transfer data in packets, reading the payload one window at a time.
+    // The window is charged to the global memory budget, which blocks
+    // here while other devices hold too much. The source's own buffers
+    // (io_uring slots, inflate input) share the lease; holding one lease
+    // while blocked on a second could deadlock.
+    //
+    // The window is split in two halves that take turns, so the helper
+    // thread hashing what was sent can finish one half while the other
+    // is refilled.
+    size_t windowSize = static_cast<size_t>(std::min<uint64_t>(info.size, TRANSFER_WINDOW_SIZE));
+    size_t halfSize = (windowSize + 1) / 2;
+    
+    // With chunk digests each half holds whole chunks, checked before
+    // any of them is sent: at least one chunk, never more than the
+    // window or the entry
+    const ChunkedEntry* chunks = (info.chunks && info.chunks->size == info.size) ? info.chunks.get() : nullptr;
+    if (chunks) {
+        size_t chunkSize = static_cast<size_t>(chunks->chunkSize);
+        size_t rounded = std::max(halfSize / chunkSize, static_cast<size_t>(1)) * chunkSize;
+        halfSize = static_cast<size_t>(std::min<uint64_t>(rounded, info.size));
+    }
+    
+    MemoryBudget::Lease lease = MemoryBudget::instance().acquire(2 * halfSize + source.bufferBytes());
+    std::unique_ptr<char[]> halves[2] = { std::unique_ptr<char[]>(new char[halfSize]),
+                                          std::unique_ptr<char[]>(new char[halfSize]) };
+    uint64_t hashTickets[2] = { 0, 0 };
+    
+    if (!sentDigest_) {
+        sentDigest_.reset(new AsyncSha256);
+    }
+    
+    // The helper may still be reading the halves on an early return
+    struct DigestGuard {
+        AsyncSha256& digest;
+        ~DigestGuard() { digest.discard(); }
+    } digestGuard{*sentDigest_};
+    
+    TransferRecord record;
+    record.filename = info.filename;
+    record.expected = info.sha256;
+    auto started = std::chrono::steady_clock::now();
+    
+    uint64_t offset = 0;
+    uint64_t remaining = info.size;
+    uint64_t windowStart = 0;
+    size_t windowFill = 0;
+    int current = 1;
     
     while (remaining > 0) {
-        size_t chunkSize = std::min(remaining, static_cast<size_t>(packetSize_));
+        if (offset == windowStart + windowFill) {
+            current ^= 1;
+            
+            // Normally long done: hashing outruns USB by far
+            sentDigest_->wait(hashTickets[current]);
+            
+            windowStart = offset;
+            windowFill = static_cast<size_t>(std::min<uint64_t>(remaining, halfSize));
+            if (!source.readFully(halves[current].get(), windowFill)) {
+                Log::error(TAG, "Failed to read payload: " + info.filename);
+                return false;
+            }
+            if (chunks && !checkChunks(*chunks, windowStart, halves[current].get(), windowFill, info.filename)) {
+                return false;
+            }
+            
+            // Let the next half load while this one is sent
+            source.readahead(halfSize);
+        }
         
-        if (!sendData(data.get() + offset, static_cast<int>(chunkSize))) {
+        size_t chunkSize = static_cast<size_t>(std::min<uint64_t>({remaining, static_cast<uint64_t>(packetSize_),
+                                                                  windowStart + windowFill - offset}));
+        const char* chunk = halves[current].get() + static_cast<size_t>(offset - windowStart);
+        
+        // Exactly what goes to the device, hashed while it is written
+        hashTickets[current] = sentDigest_->update(chunk, chunkSize);
+        
+        if (!sendData(chunk, static_cast<int>(chunkSize))) {
             Log::error(TAG, "Failed to send data chunk");
             return false;
         }
@@ -328,30 +515,124 @@ bool DownloadEngine::transmitData(const std::shared_ptr<char[]>& data,
         }
     }
     
+    // Stages validate their trailers (LZ4 end mark, CRCs) on reaching the end
+    char tail;
+    if (source.read(&tail, sizeof(tail)) != 0) {
+        Log::error(TAG, "Payload failed validation: " + info.filename);
+        return false;
+    }
+    
+    record.bytes = info.size;
+    record.sha256 = sentDigest_->finalHex();
+    record.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    
+    // Checked before FileSubCmd::End: not ending the transfer leaves the
+    // partition uncommitted
+    if (!record.expected.empty() && record.sha256 != record.expected) {
+        Log::error(TAG, "Sent data does not match the recorded digest: " + info.filename);
+        Log::error(TAG, "  expected " + record.expected + ", sent " + record.sha256);
+        transfers_.push_back(record);
+        return false;
+    }
+    
     // File transfer end (0x66, 3)
     if (!requestAndResponse(static_cast<int>(ProtocolCmd::FileTransfer),
                             static_cast<int>(FileSubCmd::End))) {
         Log::error(TAG, "Failed to end file transfer");
+        transfers_.push_back(record);
         return false;
     }
     
-    Log::info(TAG, "Transfer complete: " + info.filename);
+    record.completed = true;
+    transfers_.push_back(record);
+    
+    Log::info(TAG, "Transfer complete: " + info.filename + " (SHA-256 " + record.sha256 +
+              (record.expected.empty() ? ")" : ", verified)"));
     return true;
 }
 
-bool DownloadEngine::transmitCompressedData(const std::shared_ptr<char[]>& data,
-                                             const FirmwareInfo& info) {
+bool DownloadEngine::transmitCompressedData(const FirmwareInfo& info) {
     Log::info(TAG, "Transmitting compressed: " + info.filename);
     
     // For LZ4 compressed data, send the compressed stream directly
     // The device will decompress it
     
-    return transmitData(data, info);
+    return transmitData(info);
+}
+
+bool DownloadEngine::transmitStream() {
+    const PIT& pit = partitionTable();
+    
+    TarStream tar(firmware_->openStreamInput());
+    TarEntry entry;
+    
+    // Entries are flashed as they arrive; the stream cannot be rewound
+    // to map everything first
+    while (tar.next(entry)) {
+        if (!entry.isFile || entry.size == 0) {
+            continue;
+        }
+        
+        // Same rules as for files (FirmwareData::addTarEntry); the probe
+        // is replayed in front of the rest of the payload
+        ByteSource& payload = tar.payload();
+        char probe[LZ4_HEADER_PROBE_SIZE] = {0};
+        ssize_t probeSize = payload.readUpTo(probe, static_cast<size_t>(std::min<uint64_t>(entry.size, sizeof(probe))));
+        if (probeSize < 0) {
+            Log::error(TAG, "Failed to read: " + entry.name);
+            return false;
+        }
+        
+        FirmwareInfo info;
+        if (!FirmwareData::describeTarEntry(entry, probe, static_cast<size_t>(probeSize), info)) {
+            continue;
+        }
+        if (info.type == FirmwareType::PIT) {
+            Log::info(TAG, "Skipping " + entry.name + " from standard input, pass it with -V to repartition");
+            continue;
+        }
+        
+        PITView::Entry target = FirmwareImage::findTarget(pit, entry.name);
+        if (!target) {
+            Log::error(TAG, "No PIT entry for: " + entry.name);
+            return false;
+        }
+        info.partitionName = std::string(target.partitionName());
+        Log::info(TAG, entry.name + " -> " + info.partitionName);
+        
+        // Only this entry's header has been read, so the plan is one entry long
+        std::string problem = FlashPlan::checkSize(info, target);
+        if (problem.empty()) {
+            problem = FlashPlan::checkTransferSize(info);
+        }
+        if (!problem.empty()) {
+            Log::error(TAG, "Cannot flash: " + problem);
+            return false;
+        }
+        
+        std::unique_ptr<ByteSource> rest(new BorrowedSource(payload));
+        std::unique_ptr<ByteSource> source(new ReplaySource(probe, static_cast<size_t>(probeSize), std::move(rest)));
+        source = FirmwareImage::validatePayload(std::move(source), info);
+        
+        if (!transmitPayload(info, *source)) {
+            return false;
+        }
+    }
+    
+    if (tar.hasError()) {
+        Log::error(TAG, "Failed to read TAR from standard input");
+        return false;
+    }
+    
+    return true;
 }
 
 bool DownloadEngine::closeConnection() {
     Log::info(TAG, "Closing connection");
     
+    // No more payload reads; the page cache can drop what this device held
+    cursor_.reset();
+    
     // End session (0x67, 0)
     return requestAndResponse(static_cast<int>(ProtocolCmd::Connection),
                               static_cast<int>(ConnSubCmd::Close));
@@ -360,6 +641,12 @@ bool DownloadEngine::closeConnection() {
 bool DownloadEngine::download() {
     Log::info(TAG, "Starting download");
     
+    // Register as a reader of the firmware before the handshake, so
+    // devices that start transferring first keep the pages for this one
+    if (firmware_) {
+        cursor_.reset(new PayloadCursor(*firmware_));
+    }
+    
     // 1. Setup connection (ODIN/LOKE)
     if (!setupConnection()) {
         Log::error(TAG, "Setup connection failed");
@@ -374,6 +661,7 @@ bool DownloadEngine::download() {
     
     // 3. Get device info (optional)
     getDeviceInfo();
+    profile_.print();
     
     // 4. Receive PIT from device
     if (!receivePitInfo()) {
@@ -382,22 +670,43 @@ bool DownloadEngine::download() {
         return false;
     }
     
-    // 5. Send PIT if provided
+    // 5. Resolve target partitions before anything is written
+    if (!mapPartitions()) {
+        Log::error(TAG, "Partition mapping failed");
+        closeConnection();
+        return false;
+    }
+    
+    // 6. Reject transfers that cannot fit, while nothing is written yet
+    if (!planTransfers()) {
+        Log::error(TAG, "Flash plan rejected");
+        closeConnection();
+        return false;
+    }
+    
+    // 7. Send PIT if provided
     if (!sendPitInfo()) {
         Log::error(TAG, "Send PIT failed");
         closeConnection();
         return false;
     }
     
-    // 6. Transfer firmware files
+    // 8. Transfer firmware files
     if (firmware_) {
-        for (const auto& file : firmware_->getFiles()) {
+        const auto& files = firmware_->getFiles();
+        
+        for (size_t i = 0; i < files.size(); i++) {
+            const FirmwareInfo& file = files[i];
+            if (targets_[i]) {
+                Log::info(TAG, file.filename + " -> " + std::string(targets_[i].partitionName()));
+            }
+            
             bool success;
             
             if (file.compression == CompressionType::LZ4) {
-                success = transmitCompressedData(file.data, file);
+                success = transmitCompressedData(file);
             } else {
-                success = transmitData(file.data, file);
+                success = transmitData(file);
             }
             
             if (!success) {
@@ -406,15 +715,21 @@ bool DownloadEngine::download() {
                 return false;
             }
         }
+        
+        if (firmware_->hasStreamInput() && !transmitStream()) {
+            Log::error(TAG, "Standard input transfer failed");
+            closeConnection();
+            return false;
+        }
     }
     
-    // 7. Close connection
+    // 9. Close connection
     if (!closeConnection()) {
         Log::error(TAG, "Close connection failed");
         return false;
     }
     
-    // 8. Reboot (0x67, 1)
+    // 10. Reboot (0x67, 1)
     request(static_cast<int>(ProtocolCmd::Connection),
             static_cast<int>(ConnSubCmd::Reboot));
     
@@ -544,23 +859,13 @@ bool DownloadEngine::sendPitData(const char* data, int size) {
     return ackSize >= 8;
 }
 
-bool DownloadEngine::deviceInfoAnalysis(char* data) {
-    // Check magic number
-    uint32_t magic = *reinterpret_cast<uint32_t*>(data);
-    
-    if (magic != DEVINFO_MAGIC) {
-        Log::error(TAG, "Invalid device info magic");
+bool DownloadEngine::deviceInfoAnalysis(const char* data, size_t size) {
+    // Recorded for the log and the run report only
+    if (!profile_.parseDeviceInfo(data, size)) {
+        Log::error(TAG, "Invalid device info block");
         return false;
     }
     
-    // Parse device info structure
-    int numEntries = *reinterpret_cast<int*>(data + 4);
-    
-    Log::info(TAG, "Device info entries: " + std::to_string(numEntries));
-    
-    // Additional parsing would go here
-    // The structure contains partition info, version strings, etc.
-    
     return true;
 }
 
@@ -6,28 +6,103 @@
 #include "FirmwareData.h"
 #include "Tar.h"
 #include "Manifest.h"
+#include "HashService.h"
+#include "Sha256Engine.h"
 #include "Log.h"
 #include "OdinException.h"
 #include <fstream>
 #include <cstring>
+#include <strings.h>
 #include <algorithm>
+#include <unordered_set>
 #include <sys/stat.h>
+#include <unistd.h>
 
 // LZ4 support
 #ifdef HAVE_LZ4
 #include <lz4frame.h>
 #endif
 
-// GZIP support
-#include <zlib.h>
-
 namespace Odin {
 
 const std::string FirmwareData::TAG = "FirmwareData";
 
+// Case-insensitive suffix test, avoids building a lowercase copy per entry
+static bool endsWithNoCase(const std::string& name, const char* suffix) {
+    size_t suffixLen = strlen(suffix);
+    if (name.size() < suffixLen) {
+        return false;
+    }
+    
+    return strncasecmp(name.c_str() + name.size() - suffixLen, suffix, suffixLen) == 0;
+}
+
+// Default partition name before a PIT is applied: basename without extension
+static std::string defaultPartitionName(const std::string& filename) {
+    size_t slash = filename.find_last_of('/');
+    size_t start = (slash == std::string::npos) ? 0 : slash + 1;
+    size_t dotPos = filename.find('.', start);
+    return filename.substr(start, dotPos == std::string::npos ? std::string::npos : dotPos - start);
+}
+
+// Checksum files packed next to the images they cover
+static bool isChecksumName(const std::string& name) {
+    return endsWithNoCase(name, ".md5") || endsWithNoCase(name, ".sha256");
+}
+
+// Largest checksum entry read; md5sum output for a whole package fits
+constexpr uint64_t CHECKSUM_ENTRY_MAX_SIZE = 0x10000;   // 64KB
+
+// Contents of a checksum entry: lines of "<hex>", "<hex>  name" or
+// "<hex> *name" (md5sum/sha256sum). A bare digest covers the entry's own
+// name minus the suffix; listed names are relative to its directory.
+bool FirmwareData::parseChecksumEntry(const std::string& entryName, const std::string& contents,
+                                      std::vector<EmbeddedDigest>& digests) {
+    std::string directory = entryName.substr(0, entryName.find_last_of('/') + 1);
+    std::string bareTarget = entryName.substr(0, entryName.find_last_of('.'));
+    size_t found = digests.size();
+    
+    size_t lineStart = 0;
+    while (lineStart < contents.size()) {
+        size_t lineEnd = contents.find('\n', lineStart);
+        if (lineEnd == std::string::npos) {
+            lineEnd = contents.size();
+        }
+        std::string line = contents.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+        
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        
+        size_t hexEnd = line.find_first_of(" \t");
+        EmbeddedDigest digest;
+        digest.digest = Digest::fromHex(std::string_view(line).substr(0, hexEnd));
+        if (digest.digest.empty()) {
+            continue;
+        }
+        digest.algorithm = digest.digest.size() == SHA256_DIGEST_SIZE ? HashAlgorithm::SHA256 : HashAlgorithm::MD5;
+        
+        size_t nameStart = hexEnd == std::string::npos ? std::string::npos : line.find_first_not_of(" \t*", hexEnd);
+        digest.target = nameStart == std::string::npos ? bareTarget : directory + line.substr(nameStart);
+        digests.push_back(digest);
+    }
+    
+    return digests.size() > found;
+}
+
 FirmwareData::FirmwareData()
     : eraseEnabled_(false)
     , optionLock_(false)
+    , indexCacheEnabled_(true)
+    , readMode_(ReadMode::Buffered)
+    , tarIndexWrite_(false)
+    , chunkManifestWrite_(false)
+    , chunkVerify_(false)
+    , streamInput_(false)
     , pitSize_(0)
     , pitOffset_(0)
 {
@@ -42,10 +117,20 @@ FirmwareData::FirmwareData(const FirmwareData& other)
     , pitPath_(other.pitPath_)
     , eraseEnabled_(other.eraseEnabled_)
     , optionLock_(other.optionLock_)
+    , indexCacheEnabled_(other.indexCacheEnabled_)
+    , readMode_(other.readMode_)
+    , tarIndexWrite_(other.tarIndexWrite_)
+    , chunkManifestWrite_(other.chunkManifestWrite_)
+    , chunkVerify_(other.chunkVerify_)
+    , streamInput_(other.streamInput_)
     , files_(other.files_)
     , pitSize_(other.pitSize_)
     , pitOffset_(other.pitOffset_)
+    , pit_(other.pit_)
     , sha256Expected_(other.sha256Expected_)
+    , pending_(other.pending_)
+    , pendingEntries_(other.pendingEntries_)
+    , pendingChunks_(other.pendingChunks_)
 {
 }
 
@@ -59,10 +144,20 @@ FirmwareData& FirmwareData::operator=(const FirmwareData& other) {
         pitPath_ = other.pitPath_;
         eraseEnabled_ = other.eraseEnabled_;
         optionLock_ = other.optionLock_;
+        indexCacheEnabled_ = other.indexCacheEnabled_;
+        readMode_ = other.readMode_;
+        tarIndexWrite_ = other.tarIndexWrite_;
+        chunkManifestWrite_ = other.chunkManifestWrite_;
+        chunkVerify_ = other.chunkVerify_;
+        streamInput_ = other.streamInput_;
         files_ = other.files_;
         pitSize_ = other.pitSize_;
         pitOffset_ = other.pitOffset_;
+        pit_ = other.pit_;
         sha256Expected_ = other.sha256Expected_;
+        pending_ = other.pending_;
+        pendingEntries_ = other.pendingEntries_;
+        pendingChunks_ = other.pendingChunks_;
     }
     return *this;
 }
@@ -145,6 +240,12 @@ bool FirmwareData::setPIT(const std::string& path) {
         return false;
     }
     
+    std::vector<char> pitData(pitSize_);
+    if (!file.read(pitData.data(), pitSize_) || !pit_.parse(pitData.data(), pitSize_)) {
+        Log::error(TAG, "Invalid PIT file: " + path);
+        return false;
+    }
+    
     pitPath_ = path;
     pitOffset_ = 0;
     
@@ -161,38 +262,116 @@ void FirmwareData::setOptionLock(bool enable) {
     optionLock_ = enable;
 }
 
+void FirmwareData::setIndexCache(bool enable) {
+    indexCacheEnabled_ = enable;
+}
+
 bool FirmwareData::parseBinary(const std::string& path) {
+    // "-" is a TAR on standard input, flashed entry by entry as it arrives
+    if (path == "-") {
+        if (streamInput_) {
+            Log::error(TAG, "Only one file can be read from standard input");
+            return false;
+        }
+        streamInput_ = true;
+        Log::info(TAG, "Standard input will be streamed during the transfer");
+        return true;
+    }
+    
     Log::info(TAG, "Parsing: " + path);
     
+    // Reuse a previous parse of the same file if its identity is unchanged
+    IndexCache indexCache;
+    IndexCacheRecord record;
+    bool cacheable = indexCacheEnabled_ && FileIdentity::fromPath(path, record.identity);
+    
+    // Writing a sidecar needs the TAR opened, so the cache is not consulted
+    if (cacheable && !tarIndexWrite_ && !chunkManifestWrite_) {
+        IndexCacheRecord cached;
+        if (indexCache.load(record.identity, cached)) {
+            if (loadFromIndex(path, cached)) {
+                return true;
+            }
+            Log::info(TAG, "Index cache unusable, reparsing: " + path);
+        }
+    }
+    
+    size_t firstFile = files_.size();
+    
     // Check file extension
     std::string ext = path.substr(path.find_last_of('.') + 1);
     std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
     
-    // Check for .md5 extension (tar with md5 checksum)
-    if (ext == "md5") {
-        // Verify MD5 first
-        if (!verifyMD5(path)) {
-            Log::error(TAG, "MD5 verification failed");
+    // .md5 and .sha256 archives are hashed on the HashService while the
+    // rest is parsed; awaitVerification() collects the result
+    if (ext == "md5" || ext == "sha256") {
+        Log::info(TAG, ext == "md5" ? "Verifying MD5..." : "Verifying SHA256...");
+        
+        PendingVerification pending;
+        pending.path = path;
+        pending.algorithm = ext == "md5" ? HashAlgorithm::MD5 : HashAlgorithm::SHA256;
+        pending.digest = HashService::instance().submit(HashJob(path, pending.algorithm)).share();
+        
+        if (!parseBinaryInternal(path, &record)) {
             return false;
         }
         
-        // Then parse as TAR
-        return parseBinaryInternal(path);
+        // The cache only holds verified digests, so storing waits as well
+        record.files.assign(files_.begin() + firstFile, files_.end());
+        pending.record = record;
+        pending.cacheable = cacheable && !record.identity.path.empty();
+        pending_.push_back(pending);
+        return true;
     }
     
-    // Check for .sha256 extension
-    if (ext == "sha256") {
-        if (!verifySHA256(path)) {
-            Log::error(TAG, "SHA256 verification failed");
-            return false;
+    if (!parseBinaryInternal(path, &record)) {
+        return false;
+    }
+    
+    if (cacheable && !record.identity.path.empty()) {
+        record.files.assign(files_.begin() + firstFile, files_.end());
+        
+        if (indexCache.store(record)) {
+            Log::info(TAG, "Index cached: " + path);
         }
-        return parseBinaryInternal(path);
     }
     
-    return parseBinaryInternal(path);
+    return true;
 }
 
-bool FirmwareData::parseBinaryInternal(const std::string& path) {
+bool FirmwareData::loadFromIndex(const std::string& path, const IndexCacheRecord& record) {
+    Log::info(TAG, "Index cache hit: " + std::to_string(record.files.size()) + " files");
+    
+    if (!record.md5.empty()) {
+        Log::info(TAG, "MD5 (cached): " + record.md5);
+    }
+    if (!record.sha256.empty()) {
+        Log::info(TAG, "SHA256 (cached): " + record.sha256);
+    }
+    
+    // Payloads are read on demand, so the recorded offsets are all we need
+    size_t firstFile = files_.size();
+    for (FirmwareInfo info : record.files) {
+        info.sourcePath = path;
+        files_.push_back(info);
+    }
+    
+    if (!record.entries.empty()) {
+        attachChunkManifest(path, firstFile);
+        
+        // Packed checksums are checked on every run, like the payloads
+        // they cover they are not part of the record
+        bool hasChecksums = std::any_of(record.entries.begin(), record.entries.end(),
+                                        [](const TarEntry& entry) { return isChecksumName(entry.name); });
+        Tar tar(path);
+        if (hasChecksums && tar.open(record.entries)) {
+            queueEmbeddedChecks(tar, path);
+        }
+    }
+    return true;
+}
+
+bool FirmwareData::parseBinaryInternal(const std::string& path, IndexCacheRecord* record) {
     // Determine file type
     std::ifstream file(path, std::ios::binary);
     if (!file.is_open()) {
@@ -210,10 +389,14 @@ bool FirmwareData::parseBinaryInternal(const std::string& path) {
         static_cast<uint8_t>(header[1]) == 0x8B) {
         Log::info(TAG, "Detected GZIP file");
         
-        // Extract to temp file and parse
-        std::string tempPath = "/tmp/odin4_extracted.tar";
-        extractGzipFile(path, tempPath);
-        return parseBinaryInternal(tempPath);
+        // Decompressed on the fly, both now and when transmitting
+        return parseStream(path, {SourceStage(SourceStageKind::Gzip)});
+    }
+    
+    // Check for ZIP container (BL/AP/CP/CSC packages as distributed)
+    if (Zip::isZip(header, sizeof(header))) {
+        Log::info(TAG, "Detected ZIP file");
+        return parseZIP(path);
     }
     
     // Check for LZ4 magic
@@ -223,18 +406,14 @@ bool FirmwareData::parseBinaryInternal(const std::string& path) {
         
         FirmwareInfo info;
         info.filename = path.substr(path.find_last_of('/') + 1);
+        info.sourcePath = path;
         info.compression = CompressionType::LZ4;
         
         // Parse LZ4 frame header
         parseLZ4FrameHeader(header, info);
         
-        // Read file into memory
         std::ifstream lz4File(path, std::ios::binary | std::ios::ate);
-        info.size = lz4File.tellg();
-        lz4File.seekg(0);
-        
-        info.data = std::shared_ptr<char[]>(new char[info.size]);
-        lz4File.read(info.data.get(), info.size);
+        info.size = static_cast<uint64_t>(lz4File.tellg());
         
         files_.push_back(info);
         return true;
@@ -243,7 +422,7 @@ bool FirmwareData::parseBinaryInternal(const std::string& path) {
     // Check for TAR magic (at offset 257)
     if (memcmp(header + 257, "ustar", 5) == 0) {
         Log::info(TAG, "Detected TAR file");
-        return parseTAR(path, FirmwareType::Unknown);
+        return parseTAR(path, FirmwareType::Unknown, record);
     }
     
     // Assume binary file
@@ -251,7 +430,8 @@ bool FirmwareData::parseBinaryInternal(const std::string& path) {
     return parseBIN(path, FirmwareType::Unknown);
 }
 
-bool FirmwareData::parseTAR(const std::string& path, FirmwareType type) {
+bool FirmwareData::parseTAR(const std::string& path, FirmwareType type, IndexCacheRecord* record) {
+    size_t firstFile = files_.size();
     Tar tar(path);
     
     if (!tar.open()) {
@@ -259,78 +439,389 @@ bool FirmwareData::parseTAR(const std::string& path, FirmwareType type) {
         return false;
     }
     
+    // Hashes every entry, so the digests below are known for this run too
+    if (tarIndexWrite_ && !tar.isIndexed()) {
+        tar.writeIndex();
+    }
+    
     const auto& entries = tar.getEntries();
     Log::info(TAG, "TAR contains " + std::to_string(entries.size()) + " entries");
     
+    if (record) {
+        record->entries = entries;
+    }
+    
     for (const auto& entry : entries) {
         if (!entry.isFile || entry.size == 0) {
             continue;
         }
         
-        Log::info(TAG, "  Entry: " + entry.name + " (" + std::to_string(entry.size) + " bytes)");
+        // Only probe the start of the payload; the data itself is read
+        // in bounded windows while transmitting
+        char probe[LZ4_HEADER_PROBE_SIZE] = {0};
+        size_t probeSize = static_cast<size_t>(std::min<uint64_t>(entry.size, sizeof(probe)));
+        if (!tar.readEntryRange(entry, 0, probe, probeSize)) {
+            Log::error(TAG, "Failed to read entry: " + entry.name);
+            continue;
+        }
+        
+        size_t firstNew = files_.size();
+        addTarEntry(entry, type, path, probe, probeSize);
         
-        // Skip checksum files
-        std::string lowerName = entry.name;
-        std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+        // Checked against the bytes actually sent (see DownloadEngine)
+        for (size_t i = firstNew; i < files_.size(); i++) {
+            files_[i].sha256 = tar.getEntryDigest(entry);
+        }
+    }
+    
+    queueEmbeddedChecks(tar, path);
+    
+    if (chunkManifestWrite_ && !writeChunkManifest(tar, path)) {
+        return false;
+    }
+    attachChunkManifest(path, firstFile);
+    
+    tar.close();
+    return true;
+}
+
+void FirmwareData::queueEmbeddedChecks(const Tar& tar, const std::string& path) {
+    for (const auto& entry : tar.getEntries()) {
+        if (!entry.isFile || !isChecksumName(entry.name)) {
+            continue;
+        }
+        if (entry.size > CHECKSUM_ENTRY_MAX_SIZE) {
+            Log::info(TAG, "Ignoring oversized checksum entry: " + entry.name);
+            continue;
+        }
         
-        if (lowerName.find(".md5") != std::string::npos ||
-            lowerName.find(".sha256") != std::string::npos) {
+        std::string contents(static_cast<size_t>(entry.size), '\0');
+        std::vector<EmbeddedDigest> digests;
+        if (!tar.readEntry(entry, &contents[0], contents.size()) ||
+            !parseChecksumEntry(entry.name, contents, digests)) {
+            Log::info(TAG, "Ignoring unreadable checksum entry: " + entry.name);
             continue;
         }
         
-        FirmwareInfo info;
-        info.filename = entry.name;
-        info.size = entry.size;
-        info.offset = entry.offset;
+        // Each covered entry is hashed on its own worker
+        for (const auto& digest : digests) {
+            const TarEntry* target = tar.findEntry(digest.target);
+            if (!target) {
+                Log::info(TAG, entry.name + " lists " + digest.target + ", which is not in the archive");
+                continue;
+            }
+            
+            HashJob job(path, digest.algorithm, target->offset, target->size);
+            pendingEntries_.push_back(PendingEntryCheck{path, target->name, digest.digest,
+                                                        HashService::instance().submit(job).share()});
+            
+            // Also the digest the sent bytes are compared with, unless the
+            // .odinidx sidecar already gave one
+            if (digest.algorithm != HashAlgorithm::SHA256) {
+                continue;
+            }
+            for (auto& info : files_) {
+                if (info.sha256.empty() && info.sourcePath == path && info.filename == target->name) {
+                    info.sha256 = digest.digest.hex();
+                }
+            }
+        }
+    }
+}
+
+bool FirmwareData::writeChunkManifest(const Tar& tar, const std::string& path) {
+    ChunkManifest manifest;
+    for (const auto& entry : tar.getEntries()) {
+        if (entry.isFile && entry.size > 0 && !manifest.add(entry.name, path, entry.offset, entry.size)) {
+            return false;
+        }
+    }
+    
+    if (!manifest.save(ChunkManifest::sidecarPath(path))) {
+        return false;
+    }
+    Log::info(TAG, "Wrote chunk manifest: " + ChunkManifest::sidecarPath(path));
+    return true;
+}
+
+void FirmwareData::attachChunkManifest(const std::string& path, size_t firstFile) {
+    std::string manifestPath = ChunkManifest::sidecarPath(path);
+    if (access(manifestPath.c_str(), F_OK) != 0) {
+        return;
+    }
+    
+    // An unusable manifest only costs the chunk checks; the archive
+    // digest still covers the package
+    ChunkManifest manifest;
+    if (!manifest.load(manifestPath)) {
+        Log::error(TAG, "Ignoring chunk manifest: " + manifestPath);
+        return;
+    }
+    
+    size_t attached = 0;
+    for (size_t i = firstFile; i < files_.size(); i++) {
+        FirmwareInfo& info = files_[i];
+        std::shared_ptr<const ChunkedEntry> entry = manifest.find(info.filename);
+        if (!entry || entry->size != info.size || !info.sourceStages.empty()) {
+            continue;
+        }
+        
+        // Checked chunk by chunk as it is sent (see DownloadEngine)
+        info.chunks = entry;
+        attached++;
+        
+        if (chunkVerify_) {
+            pendingChunks_.push_back(PendingChunks{path, entry, ChunkManifest::submitVerify(*entry, path, info.offset)});
+        }
+    }
+    
+    Log::info(TAG, "Chunk manifest: " + std::to_string(attached) + " of " +
+              std::to_string(files_.size() - firstFile) + " files");
+}
+
+void FirmwareData::addTarEntry(const TarEntry& entry, FirmwareType type, const std::string& sourcePath,
+                               const char* probe, size_t probeSize) {
+    Log::info(TAG, "  Entry: " + entry.name + " (" + std::to_string(entry.size) + " bytes)");
+    
+    FirmwareInfo info;
+    if (!describeTarEntry(entry, probe, probeSize, info)) {
+        return;
+    }
+    info.sourcePath = sourcePath;
+    if (info.type != FirmwareType::PIT) {
         info.type = type;
-        info.compression = CompressionType::None;
-        
-        // Determine partition name from filename
-        // Common patterns: boot.img, system.img, modem.bin, etc.
-        if (lowerName.find(".pit") != std::string::npos) {
-            info.type = FirmwareType::PIT;
-            info.partitionName = "PIT";
-        } else if (lowerName.find("boot") != std::string::npos) {
-            info.partitionName = "BOOT";
-        } else if (lowerName.find("recovery") != std::string::npos) {
-            info.partitionName = "RECOVERY";
-        } else if (lowerName.find("system") != std::string::npos) {
-            info.partitionName = "SYSTEM";
-        } else if (lowerName.find("modem") != std::string::npos ||
-                   lowerName.find("cp_") != std::string::npos) {
-            info.partitionName = "MODEM";
-        } else if (lowerName.find("param") != std::string::npos) {
-            info.partitionName = "PARAM";
-        } else if (lowerName.find("efs") != std::string::npos) {
-            info.partitionName = "EFS";
-        } else if (lowerName.find("cache") != std::string::npos) {
-            info.partitionName = "CACHE";
-        } else if (lowerName.find("hidden") != std::string::npos) {
-            info.partitionName = "HIDDEN";
-        } else {
-            // Use filename without extension as partition name
-            size_t dotPos = entry.name.find_last_of('.');
-            info.partitionName = entry.name.substr(0, dotPos);
+    }
+    
+    files_.push_back(info);
+}
+
+bool FirmwareData::describeTarEntry(const TarEntry& entry, const char* probe, size_t probeSize,
+                                    FirmwareInfo& info) {
+    // Checksum files are not flashed; see queueEmbeddedChecks()
+    if (isChecksumName(entry.name)) {
+        return false;
+    }
+    
+    info.filename = entry.name;
+    info.size = entry.size;
+    info.offset = entry.offset;
+    info.type = FirmwareType::Unknown;
+    info.compression = CompressionType::None;
+    
+    // The real target partition comes from the PIT (see mapPartitions)
+    if (endsWithNoCase(entry.name, ".pit")) {
+        info.type = FirmwareType::PIT;
+        info.partitionName = "PIT";
+    } else {
+        info.partitionName = defaultPartitionName(entry.name);
+    }
+    
+    // Check for LZ4 compression in the data
+    if (probeSize >= 4 && 
+        *reinterpret_cast<const uint32_t*>(probe) == LZ4_MAGIC) {
+        info.compression = CompressionType::LZ4;
+        parseLZ4FrameHeader(probe, info);
+    }
+    
+    return true;
+}
+
+bool FirmwareData::parseZIP(const std::string& path) {
+    Zip zip(path);
+    
+    if (!zip.open()) {
+        Log::error(TAG, "Failed to open ZIP: " + path);
+        return false;
+    }
+    
+    // A package ships both CSC (wipes data) and HOME_CSC (keeps data);
+    // flash only CSC, as Odin does when both slots get the same package
+    bool hasCSC = false;
+    for (const auto& member : zip.getMembers()) {
+        if (member.name.compare(0, 4, "CSC_") == 0) {
+            hasCSC = true;
+        }
+    }
+    
+    for (const auto& member : zip.getMembers()) {
+        if (!endsWithNoCase(member.name, ".tar") && !endsWithNoCase(member.name, ".tar.md5") &&
+            !endsWithNoCase(member.name, ".tar.sha256") && !endsWithNoCase(member.name, ".tar.gz")) {
+            Log::info(TAG, "  Skipping ZIP member: " + member.name);
+            continue;
         }
         
-        // Read file data
-        info.data = std::shared_ptr<char[]>(new char[entry.size]);
-        if (!tar.readEntry(entry, info.data.get(), entry.size)) {
-            Log::error(TAG, "Failed to read entry: " + entry.name);
+        if (hasCSC && member.name.compare(0, 9, "HOME_CSC_") == 0) {
+            Log::info(TAG, "  Skipping ZIP member (CSC present): " + member.name);
             continue;
         }
         
-        // Check for LZ4 compression in the data
-        if (entry.size >= 4 && 
-            *reinterpret_cast<uint32_t*>(info.data.get()) == LZ4_MAGIC) {
-            info.compression = CompressionType::LZ4;
-            parseLZ4FrameHeader(info.data.get(), info);
+        Log::info(TAG, "ZIP member: " + member.name + " (" + std::to_string(member.uncompressedSize) +
+                  " bytes, " + (member.isStored() ? "stored" : "deflated") + ")");
+        
+        if (!parseStream(path, {SourceStage(SourceStageKind::ZipMember, member.name)})) {
+            return false;
         }
+    }
+    
+    return true;
+}
+
+// Consume what is left so trailing checks (ZIP CRC-32, gzip trailer) run
+static bool drain(ByteSource& source) {
+    if (source.size() != BYTE_SOURCE_UNKNOWN_SIZE) {
+        return source.skip(source.size() - source.position());
+    }
+    
+    std::vector<char> scratch(0x10000);
+    ssize_t bytesRead;
+    while ((bytesRead = source.read(scratch.data(), scratch.size())) > 0) {
+    }
+    return bytesRead == 0;
+}
+
+bool FirmwareData::parseStream(const std::string& path, std::vector<SourceStage> stages) {
+    std::unique_ptr<ByteSource> source = openSourceChain(path, stages, readMode_);
+    if (!source) {
+        return false;
+    }
+    
+    char header[512] = {0};
+    ssize_t headerSize = source->readUpTo(header, sizeof(header));
+    if (headerSize < 0) {
+        Log::error(TAG, "Failed to read: " + path);
+        return false;
+    }
+    
+    // Containers nest (zip -> tar.gz -> tar), peel one layer at a time
+    if (headerSize >= 2 && static_cast<uint8_t>(header[0]) == 0x1F &&
+        static_cast<uint8_t>(header[1]) == 0x8B) {
+        Log::info(TAG, "Detected GZIP stream");
+        stages.push_back(SourceStage(SourceStageKind::Gzip));
+        return parseStream(path, stages);
+    }
+    
+    if (headerSize == sizeof(header) && memcmp(header + 257, TAR_MAGIC, 5) == 0) {
+        // Start over so the TAR walk sees the archive from its first header
+        source = openSourceChain(path, stages, readMode_);
+        return source && parseTarStream(std::move(source), path, stages);
+    }
+    
+    return parseStreamPayload(*source, header, static_cast<size_t>(headerSize), path, stages);
+}
+
+bool FirmwareData::parseTarStream(std::unique_ptr<ByteSource> source, const std::string& path,
+                                  const std::vector<SourceStage>& stages) {
+    // Walk the TAR headers straight off the stream. Payload offsets are
+    // relative to the innermost container and reached again through the
+    // same stages when transmitting.
+    TarStream tar(std::move(source));
+    TarEntry entry;
+    size_t entryCount = 0;
+    
+    // The stream cannot go back, so packed checksums are only checked for
+    // entries that follow them; those are hashed as the walk passes them
+    std::vector<EmbeddedDigest> packed;
+    std::unordered_set<std::string> passed;
+    
+    while (tar.next(entry)) {
+        entryCount++;
         
-        files_.push_back(info);
+        if (!entry.isFile || entry.size == 0) {
+            continue;
+        }
+        
+        if (isChecksumName(entry.name) && entry.size <= CHECKSUM_ENTRY_MAX_SIZE) {
+            std::string contents(static_cast<size_t>(entry.size), '\0');
+            size_t found = packed.size();
+            if (!tar.payload().readFully(&contents[0], contents.size())) {
+                Log::error(TAG, "Truncated TAR entry: " + entry.name);
+                return false;
+            }
+            parseChecksumEntry(entry.name, contents, packed);
+            for (size_t i = found; i < packed.size(); i++) {
+                if (passed.count(packed[i].target)) {
+                    Log::info(TAG, packed[i].target + " precedes its checksum in a stream and is not checked");
+                }
+            }
+            continue;
+        }
+        passed.insert(entry.name);
+        
+        char probe[LZ4_HEADER_PROBE_SIZE] = {0};
+        size_t probeSize = static_cast<size_t>(std::min<uint64_t>(entry.size, sizeof(probe)));
+        if (!tar.payload().readFully(probe, probeSize)) {
+            Log::error(TAG, "Truncated TAR entry: " + entry.name);
+            return false;
+        }
+        
+        size_t firstNew = files_.size();
+        addTarEntry(entry, FirmwareType::Unknown, path, probe, probeSize);
+        for (size_t i = firstNew; i < files_.size(); i++) {
+            files_[i].sourceStages = stages;
+        }
+        
+        auto digest = std::find_if(packed.begin(), packed.end(),
+                                   [&entry](const EmbeddedDigest& d) { return d.target == entry.name; });
+        if (digest != packed.end()) {
+            // The probe was already taken from the entry: hash it back in front
+            ReplaySource rest(probe, probeSize, std::make_unique<BorrowedSource>(tar.payload()));
+            std::string actual = Manifest::calculate(rest, digest->algorithm);
+            std::promise<std::string> result;
+            result.set_value(actual);
+            pendingEntries_.push_back(PendingEntryCheck{path, entry.name, digest->digest, result.get_future().share()});
+        }
     }
     
-    tar.close();
+    if (tar.hasError()) {
+        Log::error(TAG, "Invalid TAR stream in " + path);
+        return false;
+    }
+    
+    Log::info(TAG, "TAR contains " + std::to_string(entryCount) + " entries");
+    
+    // End blocks and any appended MD5 follow
+    return tar.drain();
+}
+
+bool FirmwareData::parseStreamPayload(ByteSource& source, const char* header, size_t headerSize,
+                                      const std::string& path, const std::vector<SourceStage>& stages) {
+    // A single compressed image (e.g. boot.img.gz): name it after the
+    // container minus its compression suffixes
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    for (const auto& stage : stages) {
+        if (stage.kind == SourceStageKind::ZipMember) {
+            name = stage.name;
+        } else if (stage.kind == SourceStageKind::Gzip && endsWithNoCase(name, ".gz")) {
+            name.erase(name.size() - 3);
+        }
+    }
+    
+    // The size of a decompressed stream is only known once it ends
+    uint64_t size = source.size();
+    if (size == BYTE_SOURCE_UNKNOWN_SIZE) {
+        if (!drain(source)) {
+            Log::error(TAG, "Failed to read: " + path);
+            return false;
+        }
+        size = source.position();
+    }
+    
+    FirmwareInfo info;
+    info.filename = name;
+    info.sourcePath = path;
+    info.sourceStages = stages;
+    info.size = size;
+    info.offset = 0;
+    info.compression = CompressionType::None;
+    info.partitionName = defaultPartitionName(name);
+    
+    if (headerSize >= 4 && *reinterpret_cast<const uint32_t*>(header) == LZ4_MAGIC) {
+        info.compression = CompressionType::LZ4;
+        parseLZ4FrameHeader(header, info);
+    }
+    
+    Log::info(TAG, "  Payload: " + name + " (" + std::to_string(size) + " bytes)");
+    files_.push_back(info);
     return true;
 }
 
@@ -343,37 +834,103 @@ bool FirmwareData::parseBIN(const std::string& path, FirmwareType type) {
     
     FirmwareInfo info;
     info.filename = path.substr(path.find_last_of('/') + 1);
-    info.size = file.tellg();
+    info.sourcePath = path;
+    info.size = static_cast<uint64_t>(file.tellg());
     info.offset = 0;
     info.type = type;
     info.compression = CompressionType::None;
     
-    // Determine partition name from filename
-    std::string lowerName = info.filename;
-    std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+    // Default partition name, refined by mapPartitions once a PIT is known
+    info.partitionName = defaultPartitionName(info.filename);
     
-    size_t dotPos = info.filename.find_last_of('.');
-    info.partitionName = info.filename.substr(0, dotPos);
-    
-    // Read file data
+    // Probe for LZ4 compression, the payload is read on demand
     file.seekg(0);
-    info.data = std::shared_ptr<char[]>(new char[info.size]);
-    file.read(info.data.get(), info.size);
+    char probe[LZ4_HEADER_PROBE_SIZE] = {0};
+    file.read(probe, static_cast<std::streamsize>(std::min<uint64_t>(info.size, sizeof(probe))));
     
-    // Check for LZ4 compression
     if (info.size >= 4 && 
-        *reinterpret_cast<uint32_t*>(info.data.get()) == LZ4_MAGIC) {
+        *reinterpret_cast<uint32_t*>(probe) == LZ4_MAGIC) {
         info.compression = CompressionType::LZ4;
-        parseLZ4FrameHeader(info.data.get(), info);
+        parseLZ4FrameHeader(probe, info);
     }
     
     files_.push_back(info);
     return true;
 }
 
-bool FirmwareData::verifyMD5(const std::string& path) {
-    Log::info(TAG, "Verifying MD5...");
+std::shared_ptr<const FirmwareImage> FirmwareData::createImage() const {
+    return std::make_shared<const FirmwareImage>(*this);
+}
+
+bool FirmwareData::awaitVerification() {
+    bool valid = true;
+    IndexCache indexCache;
+    
+    for (auto& pending : pending_) {
+        const std::string& digest = pending.digest.get();
+        
+        bool verified;
+        if (pending.algorithm == HashAlgorithm::MD5) {
+            verified = verifyMD5(pending.path, digest);
+            pending.record.md5 = digest;
+        } else {
+            verified = verifySHA256(pending.path, digest);
+            pending.record.sha256 = digest;
+        }
+        
+        if (!verified) {
+            Log::error(TAG, std::string(pending.algorithm == HashAlgorithm::MD5 ? "MD5" : "SHA256") +
+                       " verification failed: " + pending.path);
+            valid = false;
+            continue;
+        }
+        
+        if (pending.cacheable && indexCache.store(pending.record)) {
+            Log::info(TAG, "Index cached: " + pending.path);
+        }
+    }
+    
+    size_t entriesFailed = 0;
+    for (const auto& pending : pendingEntries_) {
+        std::string digest = pending.digest.get();
+        if (Digest::fromHex(digest) != pending.expected) {
+            Log::error(TAG, pending.path + ": " + pending.name + " does not match its packed checksum");
+            Log::error(TAG, "  expected " + pending.expected.hex() + ", got " + (digest.empty() ? "read error" : digest));
+            entriesFailed++;
+        }
+    }
+    if (!pendingEntries_.empty()) {
+        Log::info(TAG, "Packed checksums: " + std::to_string(pendingEntries_.size() - entriesFailed) + " of " +
+                  std::to_string(pendingEntries_.size()) + " entries verified");
+        valid = valid && entriesFailed == 0;
+    }
+    
+    // A bad chunk names the damaged range instead of failing the archive
+    for (const auto& pending : pendingChunks_) {
+        std::vector<size_t> badChunks;
+        if (ChunkManifest::checkVerify(*pending.entry, pending.digests, &badChunks)) {
+            continue;
+        }
+        
+        for (size_t chunk : badChunks) {
+            uint64_t start = pending.entry->chunkOffset(chunk);
+            Log::error(TAG, pending.path + ": " + pending.entry->name + " bytes " + std::to_string(start) + "-" +
+                       std::to_string(start + pending.entry->chunkLength(chunk) - 1) + " (chunk " +
+                       std::to_string(chunk) + ") do not match the chunk manifest");
+        }
+        valid = false;
+    }
+    if (!pendingChunks_.empty() && valid) {
+        Log::info(TAG, "Chunk manifests verified: " + std::to_string(pendingChunks_.size()) + " entries");
+    }
     
+    pending_.clear();
+    pendingEntries_.clear();
+    pendingChunks_.clear();
+    return valid;
+}
+
+bool FirmwareData::verifyMD5(const std::string& path, const std::string& digest) {
     // The .md5 file contains the MD5 hash at the end of the filename
     // or in an accompanying .md5 file
     
@@ -382,15 +939,12 @@ bool FirmwareData::verifyMD5(const std::string& path) {
     std::string filename = (lastSlash != std::string::npos) ? 
                            path.substr(lastSlash + 1) : path;
     
-    // Calculate actual MD5
-    std::string actualMD5 = Manifest::calculateMD5(path);
-    
-    if (actualMD5.empty()) {
-        Log::error(TAG, "Failed to calculate MD5");
+    if (digest.empty()) {
+        Log::error(TAG, "Failed to calculate MD5 of " + filename);
         return false;
     }
     
-    Log::info(TAG, "MD5: " + actualMD5);
+    Log::info(TAG, "MD5: " + digest);
     
     // For .tar.md5 files, the verification is typically built into the format
     // Samsung appends the MD5 to the end of the file
@@ -398,20 +952,16 @@ bool FirmwareData::verifyMD5(const std::string& path) {
     return true;  // Assume valid if we can calculate it
 }
 
-bool FirmwareData::verifySHA256(const std::string& path) {
-    Log::info(TAG, "Verifying SHA256...");
-    
-    std::string actualSHA256 = Manifest::calculateSHA256(path);
-    
-    if (actualSHA256.empty()) {
-        Log::error(TAG, "Failed to calculate SHA256");
+bool FirmwareData::verifySHA256(const std::string& path, const std::string& digest) {
+    if (digest.empty()) {
+        Log::error(TAG, "Failed to calculate SHA256 of " + path);
         return false;
     }
     
-    Log::info(TAG, "SHA256: " + actualSHA256);
+    Log::info(TAG, "SHA256: " + digest);
     
     if (!sha256Expected_.empty()) {
-        if (actualSHA256 != sha256Expected_) {
+        if (digest != sha256Expected_) {
             Log::error(TAG, "SHA256 mismatch!");
             return false;
         }
@@ -420,35 +970,6 @@ bool FirmwareData::verifySHA256(const std::string& path) {
     return true;
 }
 
-void FirmwareData::extractGzipFile(const std::string& src, const std::string& dst) {
-    Log::info(TAG, "Extracting GZIP: " + src);
-    
-    gzFile gz = gzopen(src.c_str(), "rb");
-    if (!gz) {
-        Log::error(TAG, "Failed to open GZIP file");
-        return;
-    }
-    
-    std::ofstream out(dst, std::ios::binary);
-    if (!out.is_open()) {
-        Log::error(TAG, "Failed to create output file");
-        gzclose(gz);
-        return;
-    }
-    
-    char buffer[65536];
-    int bytesRead;
-    
-    while ((bytesRead = gzread(gz, buffer, sizeof(buffer))) > 0) {
-        out.write(buffer, bytesRead);
-    }
-    
-    gzclose(gz);
-    out.close();
-    
-    Log::info(TAG, "Extraction complete: " + dst);
-}
-
 bool FirmwareData::parseLZ4FrameHeader(const char* data, FirmwareInfo& info) {
     // LZ4 frame format:
     // [4 bytes] Magic = 0x184D2204
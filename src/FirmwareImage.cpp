@@ -0,0 +1,172 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * FirmwareImage - Immutable firmware snapshot implementation
+ */
+
+#include "FirmwareImage.h"
+#include "FirmwareData.h"
+#include "Log.h"
+#include <cstring>
+#include <strings.h>
+#include <unistd.h>
+
+namespace Odin {
+
+const std::string FirmwareImage::TAG = "FirmwareImage";
+
+FirmwareImage::FirmwareImage(const FirmwareData& data)
+    : files_(data.getFiles())
+    , pitPath_(data.getPITPath())
+    , pitSize_(data.getPITSize())
+    , pit_(data.getPIT())
+    , eraseEnabled_(data.isErase())
+    , optionLock_(data.isOptionLock())
+    , readMode_(data.getReadMode())
+    , streamInput_(data.hasStreamInput())
+{
+}
+
+bool FirmwareImage::mapPartitions(const PIT& pit, std::vector<PITView::Entry>& targets,
+                                  std::vector<std::string>& unmapped) const {
+    // The PIT keeps its filename index, so each file is one hashed lookup
+    size_t unmappedBefore = unmapped.size();
+    targets.assign(files_.size(), PITView::Entry());
+    
+    for (size_t i = 0; i < files_.size(); i++) {
+        const FirmwareInfo& info = files_[i];
+        if (info.type == FirmwareType::PIT) {
+            continue;
+        }
+        
+        PITView::Entry target = findTarget(pit, info.filename);
+        if (!target) {
+            unmapped.push_back(info.filename);
+            continue;
+        }
+        
+        targets[i] = target;
+        Log::debug(TAG, info.filename + " -> " + std::string(target.partitionName()));
+    }
+    
+    return unmapped.size() == unmappedBefore;
+}
+
+PITView::Entry FirmwareImage::findTarget(const PIT& pit, const std::string& filename) {
+    // Two lookups at most: .lz4 images are named in the PIT without the
+    // compression suffix
+    size_t slash = filename.find_last_of('/');
+    std::string_view name(filename);
+    if (slash != std::string::npos) {
+        name.remove_prefix(slash + 1);
+    }
+    
+    PITView::Entry entry = pit.view().findEntryByFilename(name);
+    if (!entry && name.size() > 4 && strncasecmp(name.data() + name.size() - 4, ".lz4", 4) == 0) {
+        entry = pit.view().findEntryByFilename(name.substr(0, name.size() - 4));
+    }
+    
+    return entry;
+}
+
+std::unique_ptr<ByteSource> FirmwareImage::openStreamInput() const {
+    if (!streamInput_) {
+        return nullptr;
+    }
+    return ByteSource::openStream(STDIN_FILENO);
+}
+
+std::unique_ptr<ByteSource> FirmwareImage::openSource(const FirmwareInfo& info,
+                                                      PageCache::Reader* cache) const {
+    std::unique_ptr<ByteSource> source;
+    
+    if (info.sourceStages.empty()) {
+        // Plain file or stored TAR entry: a file window is all it takes
+        source = ByteSource::openFile(info.sourcePath, readMode_, info.offset, info.size, cache);
+        if (source && source->size() != info.size) {
+            Log::error(TAG, "Source shorter than payload: " + info.sourcePath);
+            return nullptr;
+        }
+    } else {
+        std::unique_ptr<ByteSource> container = openSourceChain(info.sourcePath, info.sourceStages,
+                                                                readMode_, cache);
+        if (!container) {
+            return nullptr;
+        }
+        
+        // Compressed containers have no random access, the entry start
+        // is reached by decoding up to it
+        std::unique_ptr<TarEntrySource> entry(new TarEntrySource(std::move(container), info.offset, info.size));
+        if (!entry->open()) {
+            Log::error(TAG, "Cannot reach payload of: " + info.filename);
+            return nullptr;
+        }
+        source = std::move(entry);
+    }
+    
+    return validatePayload(std::move(source), info);
+}
+
+std::unique_ptr<ByteSource> FirmwareImage::validatePayload(std::unique_ptr<ByteSource> source,
+                                                           const FirmwareInfo& info) {
+    if (source && info.compression == CompressionType::LZ4) {
+        source.reset(new Lz4FrameSource(std::move(source)));
+    }
+    
+    return source;
+}
+
+static bool sameStages(const std::vector<SourceStage>& a, const std::vector<SourceStage>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].kind != b[i].kind || a[i].name != b[i].name) {
+            return false;
+        }
+    }
+    return true;
+}
+
+PayloadCursor::PayloadCursor(const FirmwareImage& image)
+    : image_(image)
+{
+    for (const auto& info : image_.getFiles()) {
+        if (readers_.find(info.sourcePath) == readers_.end()) {
+            readers_[info.sourcePath] = PageCache::instance().attach(info.sourcePath);
+        }
+    }
+}
+
+std::unique_ptr<ByteSource> PayloadCursor::open(const FirmwareInfo& info) {
+    auto reader = readers_.find(info.sourcePath);
+    PageCache::Reader* cache = reader != readers_.end() ? reader->second.get() : nullptr;
+    
+    if (info.sourceStages.empty()) {
+        return image_.openSource(info, cache);
+    }
+    
+    // Reuse the decoded container while payloads move forward through it
+    bool reuse = container_ && info.sourcePath == containerPath_ &&
+                 sameStages(info.sourceStages, containerStages_) &&
+                 container_->position() <= info.offset;
+    if (!reuse) {
+        container_ = openSourceChain(info.sourcePath, info.sourceStages, image_.getReadMode(), cache);
+        if (!container_) {
+            return nullptr;
+        }
+        containerPath_ = info.sourcePath;
+        containerStages_ = info.sourceStages;
+    }
+    
+    std::unique_ptr<ByteSource> view(new BorrowedSource(*container_));
+    std::unique_ptr<TarEntrySource> entry(new TarEntrySource(std::move(view), info.offset, info.size));
+    if (!entry->open()) {
+        Log::error(FirmwareImage::TAG, "Cannot reach payload of: " + info.filename);
+        container_.reset();
+        return nullptr;
+    }
+    
+    return FirmwareImage::validatePayload(std::move(entry), info);
+}
+
+} // namespace Odin
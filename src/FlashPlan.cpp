@@ -0,0 +1,144 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * FlashPlan - Pre-flight plan implementation
+ */
+
+#include "FlashPlan.h"
+#include "Log.h"
+#include <cstdio>
+
+namespace Odin {
+
+const std::string FlashPlan::TAG = "FlashPlan";
+
+// LZ4 frames store incompressible blocks raw, so a frame is never more
+// than its block headers and checksums (8 bytes per 64 KB block at the
+// smallest block size) plus the frame header and end mark (32) larger
+// than its content
+static uint64_t lz4ContentLowerBound(uint64_t frameSize) {
+    uint64_t overhead = frameSize / 8192 + 32;
+    return frameSize > overhead ? frameSize - overhead : 0;
+}
+
+// Bytes a payload puts on its partition, or a lower bound for it
+static uint64_t writeSize(const FirmwareInfo& info) {
+    if (info.compression != CompressionType::LZ4) {
+        return info.size;
+    }
+    return info.uncompressedSize ? info.uncompressedSize : lz4ContentLowerBound(info.size);
+}
+
+static std::string formatMB(uint64_t bytes) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f MB", static_cast<double>(bytes) / (1024 * 1024));
+    return text;
+}
+
+FlashPlan::FlashPlan()
+    : totalBytes_(0)
+    , expectedSeconds_(0)
+{
+}
+
+uint64_t FlashPlan::partitionBytes(const PITView::Entry& entry) {
+    // On MMC and UFS blockSizeOrOffset is the start block, so the block
+    // size follows from the device type; on NAND and OneNAND it depends
+    // on the chip
+    uint64_t blockSize;
+    switch (entry.deviceType()) {
+        case PITDeviceType::MMC:
+            blockSize = 512;
+            break;
+        case PITDeviceType::UFS:
+            blockSize = 4096;
+            break;
+        default:
+            return 0;
+    }
+    
+    return static_cast<uint64_t>(entry.blockCount()) * blockSize;
+}
+
+std::string FlashPlan::checkSize(const FirmwareInfo& info, const PITView::Entry& target) {
+    uint64_t capacity = partitionBytes(target);
+    if (capacity == 0) {
+        return "";
+    }
+    
+    uint64_t writeBytes = writeSize(info);
+    if (writeBytes <= capacity) {
+        return "";
+    }
+    
+    return info.filename + " needs " + std::to_string(writeBytes) + " bytes, " +
+           std::string(target.partitionName()) + " holds " + std::to_string(capacity);
+}
+
+std::string FlashPlan::checkTransferSize(const FirmwareInfo& info) {
+    if (info.size > PLAN_MAX_TRANSFER_SIZE) {
+        return info.filename + " is " + std::to_string(info.size) + " bytes, one transfer carries at most " +
+               std::to_string(PLAN_MAX_TRANSFER_SIZE);
+    }
+    
+    return "";
+}
+
+bool FlashPlan::build(const FirmwareImage& firmware, const std::vector<PITView::Entry>& targets,
+                      std::vector<std::string>& problems) {
+    size_t problemsBefore = problems.size();
+    const auto& files = firmware.getFiles();
+    
+    transfers_.clear();
+    totalBytes_ = 0;
+    expectedSeconds_ = 0;
+    
+    for (size_t i = 0; i < files.size() && i < targets.size(); i++) {
+        const FirmwareInfo& info = files[i];
+        if (!targets[i]) {
+            continue;
+        }
+        
+        PlannedTransfer transfer;
+        transfer.fileIndex = i;
+        transfer.target = targets[i];
+        transfer.sendBytes = info.size;
+        transfer.writeBytes = writeSize(info);
+        transfer.partitionBytes = partitionBytes(targets[i]);
+        transfer.seconds = static_cast<double>(info.size) / PLAN_TRANSFER_RATE;
+        
+        for (const std::string& problem : { checkSize(info, targets[i]), checkTransferSize(info) }) {
+            if (!problem.empty()) {
+                problems.push_back(problem);
+            }
+        }
+        
+        totalBytes_ += transfer.sendBytes;
+        expectedSeconds_ += transfer.seconds;
+        transfers_.push_back(transfer);
+    }
+    
+    // One partition named by two files: the later write would silently
+    // replace the earlier one
+    for (size_t a = 0; a < transfers_.size(); a++) {
+        for (size_t b = a + 1; b < transfers_.size(); b++) {
+            const PITView::Entry& first = transfers_[a].target;
+            const PITView::Entry& second = transfers_[b].target;
+            if (first.partitionId() == second.partitionId() &&
+                first.partitionName() == second.partitionName()) {
+                problems.push_back(files[transfers_[a].fileIndex].filename + " and " +
+                                   files[transfers_[b].fileIndex].filename + " both target " +
+                                   std::string(first.partitionName()));
+            }
+        }
+    }
+    
+    return problems.size() == problemsBefore;
+}
+
+void FlashPlan::print() const {
+    Log::info(TAG, "Flash plan: " + std::to_string(transfers_.size()) + " files, " +
+              formatMB(totalBytes_) + ", about " +
+              std::to_string(static_cast<long long>(expectedSeconds_ + 0.5)) + " s");
+}
+
+} // namespace Odin
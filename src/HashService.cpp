@@ -0,0 +1,86 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * HashService - Hashing worker pool implementation
+ */
+
+#include "HashService.h"
+#include "Manifest.h"
+#include <algorithm>
+
+namespace Odin {
+
+const std::string HashService::TAG = "HashService";
+
+// Upper bound on hashing threads, more only compete for the disk
+constexpr unsigned HASH_MAX_WORKERS = 8;
+
+HashService& HashService::instance() {
+    static HashService service;
+    return service;
+}
+
+HashService::HashService()
+    : workerCount_(std::min(std::max(std::thread::hardware_concurrency(), 1u), HASH_MAX_WORKERS))
+    , stopping_(false)
+{
+}
+
+HashService::~HashService() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        queue_.clear();
+    }
+    queued_.notify_all();
+    
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+std::future<std::string> HashService::submit(const HashJob& job) {
+    std::packaged_task<std::string()> task([this, job]() {
+        return Manifest::calculate(job, &stopping_);
+    });
+    std::future<std::string> result = task.get_future();
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(task));
+        
+        // Workers are started on demand, one per job up to the cap
+        if (workers_.size() < workerCount_) {
+            workers_.emplace_back(&HashService::run, this);
+        }
+    }
+    queued_.notify_one();
+    
+    return result;
+}
+
+std::vector<std::future<std::string>> HashService::submit(const std::vector<HashJob>& jobs) {
+    std::vector<std::future<std::string>> results;
+    results.reserve(jobs.size());
+    for (const auto& job : jobs) {
+        results.push_back(submit(job));
+    }
+    return results;
+}
+
+void HashService::run() {
+    for (;;) {
+        std::packaged_task<std::string()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queued_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace Odin
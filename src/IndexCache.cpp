@@ -0,0 +1,292 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * IndexCache - Persistent firmware index cache implementation
+ */
+
+#include "IndexCache.h"
+#include "CacheDirectory.h"
+#include "Log.h"
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Odin {
+
+const std::string IndexCache::TAG = "IndexCache";
+
+// Record file layout (host endianness, the cache is never shared between machines):
+// [8 bytes] magic "ODINIDXC"
+// [4 bytes] format version
+// identity, TAR entries, firmware infos, digests
+static const char INDEX_CACHE_MAGIC[8] = {'O', 'D', 'I', 'N', 'I', 'D', 'X', 'C'};
+constexpr uint32_t INDEX_CACHE_VERSION = 5;
+
+// Upper bound for counts and string lengths read from a record,
+// protects against allocating garbage from a truncated or corrupt file
+constexpr uint32_t INDEX_CACHE_MAX_COUNT = 1 << 20;
+
+static void writeU32(std::ostream& out, uint32_t value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void writeU64(std::ostream& out, uint64_t value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void writeString(std::ostream& out, const std::string& value) {
+    writeU32(out, static_cast<uint32_t>(value.size()));
+    out.write(value.data(), value.size());
+}
+
+static bool readU32(std::istream& in, uint32_t& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+static bool readU64(std::istream& in, uint64_t& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+static bool readString(std::istream& in, std::string& value) {
+    uint32_t length = 0;
+    if (!readU32(in, length) || length > INDEX_CACHE_MAX_COUNT) {
+        return false;
+    }
+    value.resize(length);
+    return length == 0 || static_cast<bool>(in.read(&value[0], length));
+}
+
+bool FileIdentity::fromPath(const std::string& path, FileIdentity& identity) {
+    char resolved[PATH_MAX];
+    if (!realpath(path.c_str(), resolved)) {
+        return false;
+    }
+    
+    struct stat st;
+    if (stat(resolved, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    
+    identity.path = resolved;
+    identity.inode = static_cast<uint64_t>(st.st_ino);
+    identity.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+    identity.mtimeNs = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+    identity.ctimeNs = static_cast<int64_t>(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+    identity.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    identity.ctimeNs = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+    return true;
+}
+
+IndexCache::IndexCache(const std::string& directory)
+    : directory_(directory.empty() ? defaultDirectory() : directory)
+{
+}
+
+IndexCache::~IndexCache() {
+}
+
+std::string IndexCache::defaultDirectory() {
+    return cacheDirectory("index");
+}
+
+std::string IndexCache::recordPath(const std::string& path) const {
+    // The full path is stored in the record and compared on load
+    return cacheFilePath(directory_, path, ".idx");
+}
+
+bool IndexCache::load(const FileIdentity& identity, IndexCacheRecord& record) const {
+    if (!privateCacheDirectory(directory_, false)) {
+        return false;
+    }
+    
+    std::ifstream in(recordPath(identity.path), std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    
+    char magic[sizeof(INDEX_CACHE_MAGIC)];
+    uint32_t version = 0;
+    if (!in.read(magic, sizeof(magic)) ||
+        memcmp(magic, INDEX_CACHE_MAGIC, sizeof(magic)) != 0 ||
+        !readU32(in, version) || version != INDEX_CACHE_VERSION) {
+        return false;
+    }
+    
+    IndexCacheRecord loaded;
+    uint64_t mtime = 0;
+    uint64_t ctime = 0;
+    if (!readString(in, loaded.identity.path) ||
+        !readU64(in, loaded.identity.inode) ||
+        !readU64(in, loaded.identity.size) ||
+        !readU64(in, mtime) ||
+        !readU64(in, ctime)) {
+        return false;
+    }
+    loaded.identity.mtimeNs = static_cast<int64_t>(mtime);
+    loaded.identity.ctimeNs = static_cast<int64_t>(ctime);
+    
+    if (loaded.identity != identity) {
+        Log::info(TAG, "Stale index for " + identity.path);
+        return false;
+    }
+    
+    uint32_t entryCount = 0;
+    if (!readU32(in, entryCount) || entryCount > INDEX_CACHE_MAX_COUNT) {
+        return false;
+    }
+    
+    loaded.entries.resize(entryCount);
+    for (auto& entry : loaded.entries) {
+        uint64_t size = 0;
+        uint64_t offset = 0;
+        uint32_t flags = 0;
+        if (!readString(in, entry.name) || !readU64(in, size) || !readU64(in, offset) ||
+            !readU32(in, flags) || !readU32(in, entry.mode) || !readU32(in, entry.mtime)) {
+            return false;
+        }
+        entry.size = size;
+        entry.offset = offset;
+        entry.isFile = (flags & 0x01) != 0;
+        entry.isDirectory = (flags & 0x02) != 0;
+    }
+    
+    uint32_t fileCount = 0;
+    if (!readU32(in, fileCount) || fileCount > INDEX_CACHE_MAX_COUNT) {
+        return false;
+    }
+    
+    loaded.files.resize(fileCount);
+    for (auto& info : loaded.files) {
+        uint32_t type = 0;
+        uint32_t compression = 0;
+        uint32_t lz4Flags = 0;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint64_t uncompressedSize = 0;
+        uint32_t stageCount = 0;
+        if (!readString(in, info.filename) || !readString(in, info.partitionName) ||
+            !readU32(in, stageCount) || stageCount > INDEX_CACHE_MAX_COUNT) {
+            return false;
+        }
+        for (uint32_t i = 0; i < stageCount; i++) {
+            uint32_t kind = 0;
+            std::string name;
+            if (!readU32(in, kind) || !readString(in, name)) {
+                return false;
+            }
+            info.sourceStages.emplace_back(static_cast<SourceStageKind>(kind), name);
+        }
+        if (!readU32(in, type) || !readU64(in, offset) || !readU64(in, size) ||
+            !readU64(in, uncompressedSize) || !readU32(in, compression) ||
+            !readU32(in, info.lz4BlockSizeId) || !readU32(in, lz4Flags) ||
+            !readString(in, info.sha256)) {
+            return false;
+        }
+        info.type = static_cast<FirmwareType>(type);
+        info.offset = offset;
+        info.size = size;
+        info.uncompressedSize = uncompressedSize;
+        info.compression = static_cast<CompressionType>(compression);
+        info.lz4ContentChecksum = (lz4Flags & 0x01) != 0;
+        info.lz4BlockChecksum = (lz4Flags & 0x02) != 0;
+        info.lz4IndependentBlocks = (lz4Flags & 0x04) != 0;
+    }
+    
+    if (!readString(in, loaded.md5) || !readString(in, loaded.sha256)) {
+        return false;
+    }
+    
+    record = std::move(loaded);
+    return true;
+}
+
+bool IndexCache::store(const IndexCacheRecord& record) const {
+    if (!privateCacheDirectory(directory_, true)) {
+        return false;
+    }
+    
+    // Write to a temporary file and rename so concurrent runs never
+    // observe a half-written record
+    std::string finalPath = recordPath(record.identity.path);
+    std::string tempPath = finalPath + ".tmp" + std::to_string(getpid());
+    
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        Log::error(TAG, "Cannot write index: " + tempPath);
+        return false;
+    }
+    
+    out.write(INDEX_CACHE_MAGIC, sizeof(INDEX_CACHE_MAGIC));
+    writeU32(out, INDEX_CACHE_VERSION);
+    
+    writeString(out, record.identity.path);
+    writeU64(out, record.identity.inode);
+    writeU64(out, record.identity.size);
+    writeU64(out, static_cast<uint64_t>(record.identity.mtimeNs));
+    writeU64(out, static_cast<uint64_t>(record.identity.ctimeNs));
+    
+    writeU32(out, static_cast<uint32_t>(record.entries.size()));
+    for (const auto& entry : record.entries) {
+        uint32_t flags = (entry.isFile ? 0x01 : 0) | (entry.isDirectory ? 0x02 : 0);
+        writeString(out, entry.name);
+        writeU64(out, entry.size);
+        writeU64(out, entry.offset);
+        writeU32(out, flags);
+        writeU32(out, entry.mode);
+        writeU32(out, entry.mtime);
+    }
+    
+    writeU32(out, static_cast<uint32_t>(record.files.size()));
+    for (const auto& info : record.files) {
+        uint32_t lz4Flags = (info.lz4ContentChecksum ? 0x01 : 0) |
+                            (info.lz4BlockChecksum ? 0x02 : 0) |
+                            (info.lz4IndependentBlocks ? 0x04 : 0);
+        writeString(out, info.filename);
+        writeString(out, info.partitionName);
+        writeU32(out, static_cast<uint32_t>(info.sourceStages.size()));
+        for (const auto& stage : info.sourceStages) {
+            writeU32(out, static_cast<uint32_t>(stage.kind));
+            writeString(out, stage.name);
+        }
+        writeU32(out, static_cast<uint32_t>(info.type));
+        writeU64(out, info.offset);
+        writeU64(out, info.size);
+        writeU64(out, info.uncompressedSize);
+        writeU32(out, static_cast<uint32_t>(info.compression));
+        writeU32(out, info.lz4BlockSizeId);
+        writeU32(out, lz4Flags);
+        writeString(out, info.sha256);
+    }
+    
+    writeString(out, record.md5);
+    writeString(out, record.sha256);
+    
+    out.close();
+    if (!out) {
+        Log::error(TAG, "Failed to write index: " + tempPath);
+        unlink(tempPath.c_str());
+        return false;
+    }
+    
+    if (rename(tempPath.c_str(), finalPath.c_str()) != 0) {
+        Log::error(TAG, "Failed to install index: " + finalPath);
+        unlink(tempPath.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+void IndexCache::invalidate(const std::string& path) const {
+    if (privateCacheDirectory(directory_, false)) {
+        unlink(recordPath(path).c_str());
+    }
+}
+
+} // namespace Odin
@@ -4,25 +4,209 @@
  */
 
 #include "Manifest.h"
+#include "ByteSource.h"
+#include "Sha256Engine.h"
+#include "DigestCache.h"
 #include "Log.h"
 #include <fstream>
-#include <sstream>
-#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 
-// Crypto++ headers
+// MD5 comes from Crypto++ or OpenSSL; SHA-256 is Sha256Engine
 #ifdef HAVE_CRYPTOPP
-#include <cryptopp/sha.h>
 #include <cryptopp/md5.h>
-#include <cryptopp/hex.h>
-#include <cryptopp/files.h>
 #else
-// Fallback to OpenSSL-style implementation
-#include <openssl/sha.h>
 #include <openssl/md5.h>
 #endif
 
 namespace Odin {
 
+const std::string Manifest::TAG = "Manifest";
+
+// Bytes per read when hashing files; large reads keep the disk streaming
+constexpr size_t HASH_READ_SIZE = 0x400000;  // 4MB
+
+struct Sha256::State {
+    uint32_t hash[8];
+    unsigned char block[SHA256_BLOCK_SIZE];     // Partial block
+    size_t fill;
+    uint64_t total;
+};
+
+Sha256::Sha256()
+    : state_(new State)
+{
+    Sha256Engine::init(state_->hash);
+    state_->fill = 0;
+    state_->total = 0;
+}
+
+Sha256::~Sha256() {
+}
+
+void Sha256::update(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    State& state = *state_;
+    state.total += size;
+    
+    if (state.fill > 0) {
+        size_t take = std::min(size, SHA256_BLOCK_SIZE - state.fill);
+        memcpy(state.block + state.fill, bytes, take);
+        state.fill += take;
+        bytes += take;
+        size -= take;
+        
+        if (state.fill < SHA256_BLOCK_SIZE) {
+            return;
+        }
+        Sha256Engine::compress(state.hash, state.block, 1);
+        state.fill = 0;
+    }
+    
+    // Whole blocks straight from the caller's buffer
+    size_t blocks = size / SHA256_BLOCK_SIZE;
+    Sha256Engine::compress(state.hash, bytes, blocks);
+    bytes += blocks * SHA256_BLOCK_SIZE;
+    size -= blocks * SHA256_BLOCK_SIZE;
+    
+    memcpy(state.block, bytes, size);
+    state.fill = size;
+}
+
+Digest Sha256::final() {
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    Sha256Engine::finish(state_->hash, state_->block, state_->fill, state_->total, digest);
+    return Digest(digest, sizeof(digest));
+}
+
+// AsyncSha256
+
+AsyncSha256::AsyncSha256()
+    : submitted_(0)
+    , completed_(0)
+    , hash_(new Sha256)
+    , busy_(false)
+    , stopping_(false)
+    , worker_(&AsyncSha256::run, this)
+{
+}
+
+AsyncSha256::~AsyncSha256() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queued_.notify_one();
+    worker_.join();
+}
+
+uint64_t AsyncSha256::update(const char* data, size_t size) {
+    uint64_t ticket;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.emplace_back(data, size);
+        ticket = ++submitted_;
+    }
+    queued_.notify_one();
+    return ticket;
+}
+
+void AsyncSha256::wait(uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    hashed_.wait(lock, [this, ticket]() { return completed_ >= ticket; });
+}
+
+std::string AsyncSha256::finalHex() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    hashed_.wait(lock, [this]() { return completed_ == submitted_; });
+    
+    std::string digest = hash_->finalHex();
+    hash_.reset(new Sha256);
+    return digest;
+}
+
+void AsyncSha256::discard() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    pending_.clear();
+    hashed_.wait(lock, [this]() { return !busy_; });
+    
+    completed_ = submitted_;
+    hash_.reset(new Sha256);
+    hashed_.notify_all();
+}
+
+void AsyncSha256::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    for (;;) {
+        queued_.wait(lock, [this]() { return stopping_ || !pending_.empty(); });
+        if (stopping_) {
+            return;     // Queued buffers may already be gone
+        }
+        
+        std::pair<const char*, size_t> piece = pending_.front();
+        pending_.pop_front();
+        
+        // Only this thread touches hash_ while busy_ is set
+        busy_ = true;
+        lock.unlock();
+        hash_->update(piece.first, piece.second);
+        lock.lock();
+        busy_ = false;
+        
+        completed_++;
+        hashed_.notify_all();
+    }
+}
+
+#ifdef HAVE_CRYPTOPP
+struct Md5::State {
+    CryptoPP::MD5 hash;
+};
+#else
+struct Md5::State {
+    MD5_CTX hash;
+};
+#endif
+
+Md5::Md5()
+    : state_(new State)
+{
+#ifndef HAVE_CRYPTOPP
+    MD5_Init(&state_->hash);
+#endif
+}
+
+Md5::~Md5() {
+}
+
+void Md5::update(const char* data, size_t size) {
+#ifdef HAVE_CRYPTOPP
+    state_->hash.Update(reinterpret_cast<const CryptoPP::byte*>(data), size);
+#else
+    MD5_Update(&state_->hash, data, size);
+#endif
+}
+
+Digest Md5::final() {
+#ifdef HAVE_CRYPTOPP
+    CryptoPP::byte digest[CryptoPP::MD5::DIGESTSIZE];
+    state_->hash.Final(digest);
+#else
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    MD5_Final(digest, &state_->hash);
+#endif
+    return Digest(digest, sizeof(digest));
+}
+
+// Manifest
+
 Manifest::Manifest(const std::string& path)
     : path_(path)
     , loaded_(false)
@@ -59,202 +243,196 @@ bool Manifest::load() {
             filename = filename.substr(1);
         }
         
-        hashes_[filename] = hash;
+        // Case does not matter once parsed
+        Digest digest = Digest::fromHex(hash);
+        if (digest.empty()) {
+            Log::info(TAG, "Ignoring malformed hash for " + filename);
+            continue;
+        }
+        hashes_.insert(filename, digest);
     }
     
     loaded_ = true;
     return true;
 }
 
-bool Manifest::verify(const std::string& filename) const {
-    auto it = hashes_.find(filename);
-    if (it == hashes_.end()) {
-        return false;
-    }
-    
-    std::string actual = calculateSHA256(path_.substr(0, path_.find_last_of('/') + 1) + filename);
-    
-    // Case-insensitive comparison
-    std::string expected = it->second;
-    std::transform(expected.begin(), expected.end(), expected.begin(), ::tolower);
-    std::transform(actual.begin(), actual.end(), actual.begin(), ::tolower);
-    
-    return actual == expected;
+// Listed files are relative to the manifest
+std::string Manifest::filePath(const std::string& filename) const {
+    return path_.substr(0, path_.find_last_of('/') + 1) + filename;
 }
 
-std::string Manifest::getHash(const std::string& filename) const {
-    auto it = hashes_.find(filename);
-    if (it != hashes_.end()) {
-        return it->second;
-    }
-    return "";
+// Manifests may list MD5 (md5sum) or SHA-256 (sha256sum) digests
+static HashAlgorithm algorithmOf(const Digest& digest) {
+    return digest.size() == SHA256_DIGEST_SIZE ? HashAlgorithm::SHA256 : HashAlgorithm::MD5;
 }
 
-std::string Manifest::calculateSHA256(const std::string& path) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) {
-        return "";
+bool Manifest::verify(const std::string& filename) const {
+    const Digest* expected = hashes_.find(filename);
+    if (!expected) {
+        return false;
     }
     
-#ifdef HAVE_CRYPTOPP
-    CryptoPP::SHA256 hash;
-    char buffer[65536];
-    
-    while (file) {
-        file.read(buffer, sizeof(buffer));
-        size_t bytesRead = file.gcount();
-        if (bytesRead > 0) {
-            hash.Update(reinterpret_cast<const CryptoPP::byte*>(buffer), bytesRead);
+    return Digest::fromHex(calculate(HashJob(filePath(filename), algorithmOf(*expected)))) == *expected;
+}
+
+bool Manifest::verify(const std::vector<std::string>& filenames, std::vector<std::string>* failed) const {
+    std::vector<HashJob> jobs;
+    std::vector<const std::string*> names;
+    std::vector<const Digest*> expected;
+    bool allMatch = true;
+    
+    for (const auto& filename : filenames) {
+        const Digest* digest = hashes_.find(filename);
+        if (!digest) {
+            allMatch = false;
+            if (failed) {
+                failed->push_back(filename);
+            }
+            continue;
         }
+        jobs.emplace_back(filePath(filename), algorithmOf(*digest));
+        names.push_back(&filename);
+        expected.push_back(digest);
     }
     
-    CryptoPP::byte digest[CryptoPP::SHA256::DIGESTSIZE];
-    hash.Final(digest);
-    
-    std::stringstream ss;
-    for (size_t i = 0; i < CryptoPP::SHA256::DIGESTSIZE; i++) {
-        ss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(digest[i]);
-    }
-    
-    return ss.str();
-#else
-    // OpenSSL fallback
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    
-    char buffer[65536];
-    while (file) {
-        file.read(buffer, sizeof(buffer));
-        size_t bytesRead = file.gcount();
-        if (bytesRead > 0) {
-            SHA256_Update(&sha256, buffer, bytesRead);
+    std::vector<std::future<std::string>> results = HashService::instance().submit(jobs);
+    for (size_t i = 0; i < results.size(); i++) {
+        if (Digest::fromHex(results[i].get()) != *expected[i]) {
+            allMatch = false;
+            if (failed) {
+                failed->push_back(*names[i]);
+            }
         }
     }
     
-    unsigned char digest[SHA256_DIGEST_LENGTH];
-    SHA256_Final(digest, &sha256);
-    
-    std::stringstream ss;
-    for (size_t i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        ss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(digest[i]);
-    }
-    
-    return ss.str();
-#endif
+    return allMatch;
 }
 
-std::string Manifest::calculateSHA256(const char* data, size_t size) {
-#ifdef HAVE_CRYPTOPP
-    CryptoPP::SHA256 hash;
-    hash.Update(reinterpret_cast<const CryptoPP::byte*>(data), size);
-    
-    CryptoPP::byte digest[CryptoPP::SHA256::DIGESTSIZE];
-    hash.Final(digest);
-    
-    std::stringstream ss;
-    for (size_t i = 0; i < CryptoPP::SHA256::DIGESTSIZE; i++) {
-        ss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(digest[i]);
+std::string Manifest::getHash(const std::string& filename) const {
+    const Digest* digest = hashes_.find(filename);
+    return digest ? digest->hex() : "";
+}
+
+std::string Manifest::calculate(const HashJob& job, const std::atomic<bool>* stop) {
+    // Whole files go through the digest cache
+    FileIdentity identity;
+    bool cacheable = job.offset == 0 && job.length == HASH_TO_END &&
+                     DigestCache::instance().isEnabled() && FileIdentity::fromPath(job.path, identity);
+    
+    std::string digest;
+    if (cacheable && DigestCache::instance().lookup(identity, job.algorithm, digest)) {
+        Log::debug(HashService::TAG, "Cached digest: " + job.path);
+        return digest;
     }
     
-    return ss.str();
-#else
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, data, size);
-    
-    unsigned char digest[SHA256_DIGEST_LENGTH];
-    SHA256_Final(digest, &sha256);
+    digest = hashRange(job, stop);
     
-    std::stringstream ss;
-    for (size_t i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        ss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(digest[i]);
+    // Not stored if the file changed while it was read
+    FileIdentity after;
+    if (cacheable && !digest.empty() && FileIdentity::fromPath(job.path, after) && after == identity) {
+        DigestCache::instance().store(identity, job.algorithm, digest);
     }
     
-    return ss.str();
-#endif
+    return digest;
 }
 
-std::string Manifest::calculateMD5(const std::string& path) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) {
+std::string Manifest::hashRange(const HashJob& job, const std::atomic<bool>* stop) {
+    int fd = ::open(job.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
         return "";
     }
+    posix_fadvise(fd, static_cast<off_t>(job.offset), 0, POSIX_FADV_SEQUENTIAL);
     
-#ifdef HAVE_CRYPTOPP
-    CryptoPP::MD5 hash;
-    char buffer[65536];
+    std::vector<char> buffer(HASH_READ_SIZE);
+    Sha256 sha256;
+    Md5 md5;
+    
+    uint64_t offset = job.offset;
+    uint64_t remaining = job.length;
+    bool failed = false;
     
-    while (file) {
-        file.read(buffer, sizeof(buffer));
-        size_t bytesRead = file.gcount();
-        if (bytesRead > 0) {
-            hash.Update(reinterpret_cast<const CryptoPP::byte*>(buffer), bytesRead);
+    while (remaining > 0) {
+        if (stop && *stop) {
+            failed = true;
+            break;
+        }
+        
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+        ssize_t bytesRead = pread(fd, buffer.data(), chunk, static_cast<off_t>(offset));
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead < 0) {
+            failed = true;
+            break;
+        }
+        if (bytesRead == 0) {
+            // End of file: fine when hashing to the end
+            failed = job.length != HASH_TO_END;
+            break;
+        }
+        
+        if (job.algorithm == HashAlgorithm::SHA256) {
+            sha256.update(buffer.data(), static_cast<size_t>(bytesRead));
+        } else {
+            md5.update(buffer.data(), static_cast<size_t>(bytesRead));
+        }
+        offset += static_cast<uint64_t>(bytesRead);
+        if (remaining != HASH_TO_END) {
+            remaining -= static_cast<uint64_t>(bytesRead);
         }
     }
     
-    CryptoPP::byte digest[CryptoPP::MD5::DIGESTSIZE];
-    hash.Final(digest);
-    
-    std::stringstream ss;
-    for (size_t i = 0; i < CryptoPP::MD5::DIGESTSIZE; i++) {
-        ss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(digest[i]);
+    ::close(fd);
+    if (failed) {
+        return "";
     }
     
-    return ss.str();
-#else
-    MD5_CTX md5;
-    MD5_Init(&md5);
-    
-    char buffer[65536];
-    while (file) {
-        file.read(buffer, sizeof(buffer));
-        size_t bytesRead = file.gcount();
-        if (bytesRead > 0) {
-            MD5_Update(&md5, buffer, bytesRead);
+    return job.algorithm == HashAlgorithm::SHA256 ? sha256.finalHex() : md5.finalHex();
+}
+
+std::string Manifest::calculateSHA256(const std::string& path) {
+    return calculate(HashJob(path, HashAlgorithm::SHA256));
+}
+
+std::string Manifest::calculateSHA256(const char* data, size_t size) {
+    Sha256 hash;
+    hash.update(data, size);
+    return hash.finalHex();
+}
+
+std::string Manifest::calculate(ByteSource& source, HashAlgorithm algorithm) {
+    std::vector<char> buffer(HASH_READ_SIZE);
+    Sha256 sha256;
+    Md5 md5;
+    
+    ssize_t bytesRead;
+    while ((bytesRead = source.read(buffer.data(), buffer.size())) > 0) {
+        if (algorithm == HashAlgorithm::SHA256) {
+            sha256.update(buffer.data(), static_cast<size_t>(bytesRead));
+        } else {
+            md5.update(buffer.data(), static_cast<size_t>(bytesRead));
         }
     }
-    
-    unsigned char digest[MD5_DIGEST_LENGTH];
-    MD5_Final(digest, &md5);
-    
-    std::stringstream ss;
-    for (size_t i = 0; i < MD5_DIGEST_LENGTH; i++) {
-        ss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(digest[i]);
+    if (bytesRead < 0) {
+        return "";
     }
     
-    return ss.str();
-#endif
+    return algorithm == HashAlgorithm::SHA256 ? sha256.finalHex() : md5.finalHex();
+}
+
+std::string Manifest::calculateSHA256(ByteSource& source) {
+    return calculate(source, HashAlgorithm::SHA256);
+}
+
+std::string Manifest::calculateMD5(const std::string& path) {
+    return calculate(HashJob(path, HashAlgorithm::MD5));
 }
 
 std::string Manifest::calculateMD5(const char* data, size_t size) {
-#ifdef HAVE_CRYPTOPP
-    CryptoPP::MD5 hash;
-    hash.Update(reinterpret_cast<const CryptoPP::byte*>(data), size);
-    
-    CryptoPP::byte digest[CryptoPP::MD5::DIGESTSIZE];
-    hash.Final(digest);
-    
-    std::stringstream ss;
-    for (size_t i = 0; i < CryptoPP::MD5::DIGESTSIZE; i++) {
-        ss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(digest[i]);
-    }
-    
-    return ss.str();
-#else
-    MD5_CTX md5;
-    MD5_Init(&md5);
-    MD5_Update(&md5, data, size);
-    
-    unsigned char digest[MD5_DIGEST_LENGTH];
-    MD5_Final(digest, &md5);
-    
-    std::stringstream ss;
-    for (size_t i = 0; i < MD5_DIGEST_LENGTH; i++) {
-        ss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(digest[i]);
-    }
-    
-    return ss.str();
-#endif
+    Md5 hash;
+    hash.update(data, size);
+    return hash.finalHex();
 }
 
 } // namespace Odin
@@ -0,0 +1,94 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * MemoryBudget - Firmware memory budget implementation
+ */
+
+#include "MemoryBudget.h"
+#include "Log.h"
+#include <string>
+
+namespace Odin {
+
+const std::string MemoryBudget::TAG = "MemoryBudget";
+
+MemoryBudget::Lease& MemoryBudget::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        reset();
+        budget_ = other.budget_;
+        bytes_ = other.bytes_;
+        other.budget_ = nullptr;
+        other.bytes_ = 0;
+    }
+    return *this;
+}
+
+void MemoryBudget::Lease::reset() {
+    if (budget_ && bytes_ > 0) {
+        budget_->release(bytes_);
+    }
+    budget_ = nullptr;
+    bytes_ = 0;
+}
+
+MemoryBudget& MemoryBudget::instance() {
+    static MemoryBudget budget;
+    return budget;
+}
+
+MemoryBudget::MemoryBudget()
+    : limit_(0)
+    , usage_(0)
+    , peak_(0)
+{
+}
+
+void MemoryBudget::setLimit(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limit_ = bytes;
+    }
+    available_.notify_all();
+}
+
+size_t MemoryBudget::getLimit() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_;
+}
+
+MemoryBudget::Lease MemoryBudget::acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    if (limit_ != 0 && usage_ + bytes > limit_ && usage_ != 0) {
+        Log::debug(TAG, "Waiting for " + std::to_string(bytes) + " bytes");
+        available_.wait(lock, [this, bytes] {
+            return limit_ == 0 || usage_ + bytes <= limit_ || usage_ == 0;
+        });
+    }
+    
+    usage_ += bytes;
+    if (usage_ > peak_) {
+        peak_ = usage_;
+    }
+    
+    return Lease(this, bytes);
+}
+
+void MemoryBudget::release(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        usage_ -= bytes;
+    }
+    available_.notify_all();
+}
+
+size_t MemoryBudget::getUsage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return usage_;
+}
+
+size_t MemoryBudget::getPeak() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_;
+}
+
+} // namespace Odin
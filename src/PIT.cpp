@@ -6,6 +6,7 @@
 #include "PIT.h"
 #include "Log.h"
 #include <cstring>
+#include <cstddef>
 #include <algorithm>
 
 namespace Odin {
@@ -40,103 +41,202 @@ struct PITRawEntry {
 static_assert(sizeof(PITHeader) == 24, "PITHeader size mismatch");
 static_assert(sizeof(PITRawEntry) == 132, "PITRawEntry size mismatch");
 
-PIT::PIT()
-    : headerCount_(0)
-{
+static_assert(offsetof(PITRawEntry, partitionName) == 36 && offsetof(PITRawEntry, flashFilename) == 68 &&
+              offsetof(PITRawEntry, fotaFilename) == 100, "PITView name offsets");
+
+// PITView
+
+uint32_t PITView::Entry::field(size_t index) const {
+    // Records are packed, so fields may be unaligned
+    uint32_t value;
+    memcpy(&value, raw_ + index * sizeof(uint32_t), sizeof(value));
+    return value;
 }
 
-PIT::~PIT() {
+std::string_view PITView::Entry::name(size_t offset, size_t length) const {
+    return std::string_view(raw_ + offset, strnlen(raw_ + offset, length));
 }
 
-bool PIT::parse(const char* data, size_t size) {
+PITEntry PITView::Entry::toEntry() const {
+    PITEntry entry;
+    entry.binaryType = binaryType();
+    entry.deviceType = deviceType();
+    entry.partitionId = partitionId();
+    entry.attributes = attributes();
+    entry.updateAttributes = updateAttributes();
+    entry.blockSizeOrOffset = blockSizeOrOffset();
+    entry.blockCount = blockCount();
+    entry.fileOffset = fileOffset();
+    entry.fileSize = fileSize();
+    entry.partitionName = std::string(partitionName());
+    entry.flashFilename = std::string(flashFilename());
+    entry.fotaFilename = std::string(fotaFilename());
+    return entry;
+}
+
+PITView::PITView()
+    : entries_(nullptr)
+    , count_(0)
+{
+}
+
+bool PITView::parse(const char* data, size_t size) {
+    *this = PITView();
+    
     if (size < sizeof(PITHeader)) {
         return false;
     }
     
-    const PITHeader* header = reinterpret_cast<const PITHeader*>(data);
+    PITHeader header;
+    memcpy(&header, data, sizeof(header));
     
-    // Verify magic
-    if (header->magic != PIT_MAGIC) {
+    // Every entry the header announces has to be in the buffer
+    if (header.magic != PIT_MAGIC ||
+        header.entryCount > (size - sizeof(PITHeader)) / sizeof(PITRawEntry)) {
         return false;
     }
     
-    headerCount_ = header->entryCount;
-    gangName_ = std::string(header->gangName, strnlen(header->gangName, 8));
-    projectName_ = std::string(header->projectName, strnlen(header->projectName, 8));
-    
-    // Parse entries
-    entries_.clear();
-    const char* entryPtr = data + sizeof(PITHeader);
+    entries_ = data + sizeof(PITHeader);
+    count_ = header.entryCount;
+    gangName_ = std::string_view(data + offsetof(PITHeader, gangName), strnlen(data + offsetof(PITHeader, gangName), 8));
+    projectName_ = std::string_view(data + offsetof(PITHeader, projectName),
+                                    strnlen(data + offsetof(PITHeader, projectName), 8));
     
-    for (uint32_t i = 0; i < headerCount_; i++) {
-        if (entryPtr + sizeof(PITRawEntry) > data + size) {
-            break;
+    byPartition_.reserve(count_);
+    byFlashFilename_.reserve(count_);
+    byFotaFilename_.reserve(count_);
+    for (size_t i = 0; i < count_; i++) {
+        Entry entry = getEntry(i);
+        byPartition_.emplace(entry.partitionName(), i);
+        if (!entry.flashFilename().empty()) {
+            byFlashFilename_.emplace(entry.flashFilename(), i);
+        }
+        if (!entry.fotaFilename().empty()) {
+            byFotaFilename_.emplace(entry.fotaFilename(), i);
         }
-        
-        const PITRawEntry* rawEntry = reinterpret_cast<const PITRawEntry*>(entryPtr);
-        
-        PITEntry entry;
-        entry.binaryType = static_cast<PITBinaryType>(rawEntry->binaryType);
-        entry.deviceType = static_cast<PITDeviceType>(rawEntry->deviceType);
-        entry.partitionId = rawEntry->partitionId;
-        entry.attributes = rawEntry->attributes;
-        entry.updateAttributes = rawEntry->updateAttributes;
-        entry.blockSizeOrOffset = rawEntry->blockSizeOrOffset;
-        entry.blockCount = rawEntry->blockCount;
-        entry.fileOffset = rawEntry->fileOffset;
-        entry.fileSize = rawEntry->fileSize;
-        entry.partitionName = std::string(rawEntry->partitionName, 
-                                          strnlen(rawEntry->partitionName, 32));
-        entry.flashFilename = std::string(rawEntry->flashFilename,
-                                          strnlen(rawEntry->flashFilename, 32));
-        entry.fotaFilename = std::string(rawEntry->fotaFilename,
-                                         strnlen(rawEntry->fotaFilename, 32));
-        
-        entries_.push_back(entry);
-        entryPtr += sizeof(PITRawEntry);
     }
     
     return true;
 }
 
-const PITEntry* PIT::findEntry(const std::string& partitionName) const {
-    for (const auto& entry : entries_) {
-        if (entry.partitionName == partitionName) {
-            return &entry;
-        }
+PITView::Entry PITView::getEntry(size_t index) const {
+    return index < count_ ? Entry(entries_ + index * sizeof(PITRawEntry)) : Entry();
+}
+
+size_t PITView::findPartition(std::string_view partitionName) const {
+    auto it = byPartition_.find(partitionName);
+    return it != byPartition_.end() ? it->second : count_;
+}
+
+size_t PITView::findFilename(std::string_view filename) const {
+    // An entry matches on either name, so the earlier of the two hits
+    size_t found = count_;
+    
+    auto it = byFlashFilename_.find(filename);
+    if (it != byFlashFilename_.end()) {
+        found = it->second;
+    }
+    
+    it = byFotaFilename_.find(filename);
+    if (it != byFotaFilename_.end()) {
+        found = std::min(found, it->second);
     }
-    return nullptr;
+    
+    return found;
 }
 
-const PITEntry* PIT::findEntryByFilename(const std::string& filename) const {
-    for (const auto& entry : entries_) {
-        if (entry.flashFilename == filename) {
-            return &entry;
-        }
-        
-        // Also check FOTA filename
-        if (entry.fotaFilename == filename) {
-            return &entry;
-        }
+PITView::Entry PITView::findEntry(std::string_view partitionName) const {
+    return getEntry(findPartition(partitionName));
+}
+
+PITView::Entry PITView::findEntryByFilename(std::string_view filename) const {
+    return getEntry(findFilename(filename));
+}
+
+// PIT
+
+PIT::PIT()
+    : entriesBuilt_(new std::once_flag)
+{
+}
+
+PIT::PIT(const PIT& other)
+    : raw_(other.raw_)
+    , entriesBuilt_(new std::once_flag)
+{
+    // The view points into raw_, so it is rebuilt over the copy
+    if (!raw_.empty()) {
+        view_.parse(raw_.data(), raw_.size());
+    }
+}
+
+PIT& PIT::operator=(const PIT& other) {
+    if (this != &other) {
+        PIT copy(other);
+        raw_.swap(copy.raw_);
+        std::swap(view_, copy.view_);
+        entriesBuilt_.swap(copy.entriesBuilt_);
+        entries_.swap(copy.entries_);
     }
-    return nullptr;
+    return *this;
+}
+
+PIT::~PIT() {
+}
+
+bool PIT::parse(const char* data, size_t size) {
+    std::vector<char> raw(data, data + size);
+    PITView view;
+    if (!view.parse(raw.data(), raw.size())) {
+        return false;
+    }
+    
+    // The view's pointers stay valid when the vector is moved
+    raw_ = std::move(raw);
+    view_ = std::move(view);
+    entriesBuilt_.reset(new std::once_flag);
+    entries_.clear();
+    return true;
+}
+
+const std::vector<PITEntry>& PIT::getEntries() const {
+    std::call_once(*entriesBuilt_, [this]() {
+        entries_.reserve(view_.getEntryCount());
+        for (size_t i = 0; i < view_.getEntryCount(); i++) {
+            entries_.push_back(view_.getEntry(i).toEntry());
+        }
+    });
+    return entries_;
+}
+
+const PITEntry* PIT::findEntry(const std::string& partitionName) const {
+    size_t index = view_.findPartition(partitionName);
+    return index < view_.getEntryCount() ? &getEntries()[index] : nullptr;
+}
+
+const PITEntry* PIT::findEntryByFilename(const std::string& filename) const {
+    size_t index = view_.findFilename(filename);
+    return index < view_.getEntryCount() ? &getEntries()[index] : nullptr;
 }
 
 std::vector<char> PIT::serialize() const {
-    size_t totalSize = sizeof(PITHeader) + entries_.size() * sizeof(PITRawEntry);
+    const std::vector<PITEntry>& entries = getEntries();
+    std::string gangName(view_.getGangName());
+    std::string projectName(view_.getProjectName());
+    size_t totalSize = sizeof(PITHeader) + entries.size() * sizeof(PITRawEntry);
     std::vector<char> buffer(totalSize, 0);
     
     // Write header
     PITHeader* header = reinterpret_cast<PITHeader*>(buffer.data());
     header->magic = PIT_MAGIC;
-    header->entryCount = static_cast<uint32_t>(entries_.size());
-    strncpy(header->gangName, gangName_.c_str(), 8);
-    strncpy(header->projectName, projectName_.c_str(), 8);
+    header->entryCount = static_cast<uint32_t>(entries.size());
+    strncpy(header->gangName, gangName.c_str(), 8);
+    strncpy(header->projectName, projectName.c_str(), 8);
     
     // Write entries
     char* entryPtr = buffer.data() + sizeof(PITHeader);
     
-    for (const auto& entry : entries_) {
+    for (const auto& entry : entries) {
         PITRawEntry* rawEntry = reinterpret_cast<PITRawEntry*>(entryPtr);
         
         rawEntry->binaryType = static_cast<uint32_t>(entry.binaryType);
@@ -159,15 +259,15 @@ std::vector<char> PIT::serialize() const {
 }
 
 void PIT::print() const {
-    Log::print("PIT", "Gang: " + gangName_ + ", Project: " + projectName_);
-    Log::print("PIT", "Entries: " + std::to_string(entries_.size()));
+    Log::print("PIT", "Gang: " + std::string(view_.getGangName()) + ", Project: " + std::string(view_.getProjectName()));
+    Log::print("PIT", "Entries: " + std::to_string(view_.getEntryCount()));
     
-    for (size_t i = 0; i < entries_.size(); i++) {
-        const auto& e = entries_[i];
-        Log::print("PIT", "  [" + std::to_string(i) + "] " + e.partitionName + 
-                   " -> " + e.flashFilename +
-                   " (ID=" + std::to_string(e.partitionId) + 
-                   ", Size=" + std::to_string(e.blockCount) + " blocks)");
+    for (size_t i = 0; i < view_.getEntryCount(); i++) {
+        PITView::Entry e = view_.getEntry(i);
+        Log::print("PIT", "  [" + std::to_string(i) + "] " + std::string(e.partitionName()) +
+                   " -> " + std::string(e.flashFilename()) +
+                   " (ID=" + std::to_string(e.partitionId()) +
+                   ", Size=" + std::to_string(e.blockCount()) + " blocks)");
     }
 }
 
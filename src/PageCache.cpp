@@ -0,0 +1,159 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * PageCache - Page cache policy implementation
+ */
+
+#include "PageCache.h"
+#include "Log.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace Odin {
+
+const std::string PageCache::TAG = "PageCache";
+
+// Marks a free reader slot
+constexpr uint64_t PAGE_CACHE_DETACHED = ~static_cast<uint64_t>(0);
+
+struct PageCache::File {
+    std::pair<uint64_t, uint64_t> key;
+    int fd;                             // Only used for advice
+    uint64_t dropped;                   // Everything before was dropped
+    std::vector<uint64_t> cursors;      // Per reader slot
+    size_t readers;
+};
+
+PageCache::Reader::~Reader() {
+    cache_.detach(*this);
+}
+
+PageCache& PageCache::instance() {
+    static PageCache cache;
+    return cache;
+}
+
+PageCache::PageCache()
+    : dropBehind_(true)
+{
+}
+
+void PageCache::setDropBehind(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dropBehind_ = enable;
+}
+
+bool PageCache::isDropBehind() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropBehind_;
+}
+
+std::unique_ptr<PageCache::Reader> PageCache::attach(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return nullptr;
+    }
+    
+    std::pair<uint64_t, uint64_t> key(static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino));
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = files_.find(key);
+    if (it == files_.end()) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            Log::debug(TAG, "Cannot open for advice: " + path);
+            return nullptr;
+        }
+        
+        std::unique_ptr<File> file(new File());
+        file->key = key;
+        file->fd = fd;
+        file->dropped = 0;
+        file->readers = 0;
+        it = files_.emplace(key, std::move(file)).first;
+    }
+    
+    File& file = *it->second;
+    
+    size_t slot = 0;
+    while (slot < file.cursors.size() && file.cursors[slot] != PAGE_CACHE_DETACHED) {
+        slot++;
+    }
+    if (slot == file.cursors.size()) {
+        file.cursors.push_back(0);
+    } else {
+        file.cursors[slot] = 0;
+    }
+    file.readers++;
+    
+    // A new reader starts at the beginning again
+    file.dropped = 0;
+    posix_fadvise(file.fd, 0, static_cast<off_t>(PAGE_CACHE_AHEAD), POSIX_FADV_WILLNEED);
+    
+    return std::unique_ptr<Reader>(new Reader(*this, &file, slot));
+}
+
+void PageCache::update(Reader& reader, uint64_t offset) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    File& file = *reader.file_;
+    
+    reader.reported_ = offset;
+    file.cursors[reader.slot_] = offset;
+    
+    posix_fadvise(file.fd, static_cast<off_t>(offset), static_cast<off_t>(PAGE_CACHE_AHEAD),
+                  POSIX_FADV_WILLNEED);
+    
+    // Rewound into dropped pages: they are read again and dropped again
+    // once passed
+    if (offset < file.dropped) {
+        file.dropped = offset & ~(PAGE_CACHE_STEP - 1);
+    }
+    
+    dropBehind(file);
+}
+
+void PageCache::detach(Reader& reader) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    File& file = *reader.file_;
+    
+    file.cursors[reader.slot_] = PAGE_CACHE_DETACHED;
+    file.readers--;
+    
+    if (file.readers > 0) {
+        dropBehind(file);
+        return;
+    }
+    
+    // Last reader: nothing of the file is needed any more
+    if (dropBehind_) {
+        posix_fadvise(file.fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    ::close(file.fd);
+    files_.erase(file.key);
+}
+
+void PageCache::dropBehind(File& file) {
+    if (!dropBehind_) {
+        return;
+    }
+    
+    uint64_t slowest = PAGE_CACHE_DETACHED;
+    for (uint64_t cursor : file.cursors) {
+        slowest = std::min(slowest, cursor);
+    }
+    if (slowest == PAGE_CACHE_DETACHED) {
+        return;
+    }
+    
+    // Whole steps only, the slowest reader may still be in the last one
+    uint64_t end = slowest & ~(PAGE_CACHE_STEP - 1);
+    if (end > file.dropped) {
+        posix_fadvise(file.fd, static_cast<off_t>(file.dropped), static_cast<off_t>(end - file.dropped),
+                      POSIX_FADV_DONTNEED);
+        file.dropped = end;
+    }
+}
+
+} // namespace Odin
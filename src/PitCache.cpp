@@ -0,0 +1,85 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * PitCache - Device PIT cache implementation
+ */
+
+#include "PitCache.h"
+#include "Manifest.h"
+#include "Log.h"
+
+namespace Odin {
+
+const std::string PitCache::TAG = "PitCache";
+
+CachedPit::CachedPit(const std::string& product, const Digest& digest, const PIT& pit)
+    : product_(product)
+    , digest_(digest)
+    , pit_(pit)
+{
+}
+
+bool CachedPit::mapPartitions(const std::shared_ptr<const FirmwareImage>& firmware,
+                              std::vector<PITView::Entry>& targets,
+                              std::vector<std::string>& unmapped) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    for (const auto& plan : plans_) {
+        if (plan.firmware.lock() == firmware) {
+            targets = plan.targets;
+            return true;
+        }
+    }
+    
+    if (!firmware->mapPartitions(pit_, targets, unmapped)) {
+        return false;
+    }
+    
+    Plan plan;
+    plan.firmware = firmware;
+    plan.targets = targets;
+    plans_.push_back(std::move(plan));
+    return true;
+}
+
+PitCache& PitCache::instance() {
+    static PitCache cache;
+    return cache;
+}
+
+PitCache::PitCache()
+    : enabled_(true)
+{
+}
+
+std::shared_ptr<const CachedPit> PitCache::acquire(const std::string& product, const char* data, size_t size) {
+    Sha256 sha;
+    sha.update(data, size);
+    Digest digest = sha.final();
+    
+    std::string key = product + "\n" + digest.hex();
+    if (enabled_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pits_.find(key);
+        if (it != pits_.end()) {
+            Log::debug(TAG, "PIT " + digest.hex().substr(0, 16) + " already parsed for " + product);
+            return it->second;
+        }
+    }
+    
+    PIT pit;
+    if (!pit.parse(data, size)) {
+        return nullptr;
+    }
+    auto cached = std::make_shared<const CachedPit>(product, digest, pit);
+    
+    if (!enabled_) {
+        return cached;
+    }
+    
+    // Another device of the same model may have got here first
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto inserted = pits_.emplace(key, cached);
+    return inserted.first->second;
+}
+
+} // namespace Odin
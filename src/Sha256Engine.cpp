@@ -0,0 +1,466 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * Sha256Engine - SHA-256 kernels and runtime dispatch
+ */
+
+#include "Sha256Engine.h"
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ODIN4_SHA256_X86 1
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+#if defined(__aarch64__)
+#define ODIN4_SHA256_ARM 1
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#if defined(__clang__)
+#define ODIN4_TARGET_ARM_SHA __attribute__((target("sha2")))
+#else
+#define ODIN4_TARGET_ARM_SHA __attribute__((target("+crypto")))
+#endif
+#endif
+
+namespace Odin {
+
+// Streams per AVX2 register
+constexpr size_t SHA256_AVX2_LANES = 8;
+
+alignas(16) static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline uint32_t loadBE32(const unsigned char* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+// Portable
+
+static void compressPortable(uint32_t state[8], const unsigned char* data, size_t blocks) {
+    uint32_t w[64];
+    
+    while (blocks--) {
+        for (int t = 0; t < 16; t++) {
+            w[t] = loadBE32(data + 4 * t);
+        }
+        for (int t = 16; t < 64; t++) {
+            uint32_t s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+        
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        
+        for (int t = 0; t < 64; t++) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += SHA256_BLOCK_SIZE;
+    }
+}
+
+#ifdef ODIN4_SHA256_X86
+
+// x86 SHA extensions. The state is kept as ABEF/CDGH as sha256rnds2
+// expects; each iteration does four rounds and schedules four words.
+__attribute__((target("sha,sse4.1,ssse3")))
+static void compressShaNi(uint32_t state[8], const unsigned char* data, size_t blocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);                 // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);           // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);   // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);        // CDGH
+    
+    while (blocks--) {
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+        __m128i w[4];
+        
+        for (int i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), byteSwap);
+            } else {
+                // Quads i-4 .. i-1 sit in w[i & 3] .. w[(i + 3) & 3]
+                __m128i next = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                w[i & 3] = _mm_sha256msg2_epu32(next, w[(i + 3) & 3]);
+            }
+            
+            __m128i msg = _mm_add_epi32(w[i & 3], _mm_load_si128(reinterpret_cast<const __m128i*>(&K[4 * i])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        }
+        
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+        data += SHA256_BLOCK_SIZE;
+    }
+    
+    tmp = _mm_shuffle_epi32(state0, 0x1B);              // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);           // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);        // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);           // ABEF -> HGFE
+    
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+// AVX2: eight independent streams, one per 32-bit lane
+
+__attribute__((target("avx2")))
+static inline __m256i rotr8x(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+__attribute__((target("avx2")))
+static void compressAvx2(uint32_t* const* states, const unsigned char* const* data, size_t blocks) {
+    alignas(32) uint32_t lanes[SHA256_AVX2_LANES];
+    __m256i s[8];
+    
+    for (int j = 0; j < 8; j++) {
+        for (size_t lane = 0; lane < SHA256_AVX2_LANES; lane++) {
+            lanes[lane] = states[lane][j];
+        }
+        s[j] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes));
+    }
+    
+    for (size_t block = 0; block < blocks; block++) {
+        size_t base = block * SHA256_BLOCK_SIZE;
+        __m256i w[16];
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        
+        for (int t = 0; t < 64; t++) {
+            __m256i wt;
+            if (t < 16) {
+                for (size_t lane = 0; lane < SHA256_AVX2_LANES; lane++) {
+                    lanes[lane] = loadBE32(data[lane] + base + 4 * t);
+                }
+                wt = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes));
+            } else {
+                __m256i w15 = w[(t - 15) & 15];
+                __m256i w2 = w[(t - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8x(w15, 7), rotr8x(w15, 18)),
+                                              _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8x(w2, 17), rotr8x(w2, 19)),
+                                              _mm256_srli_epi32(w2, 10));
+                wt = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+            }
+            w[t & 15] = wt;
+            
+            __m256i sigma1 = _mm256_xor_si256(_mm256_xor_si256(rotr8x(e, 6), rotr8x(e, 11)), rotr8x(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, sigma1),
+                                          _mm256_add_epi32(_mm256_add_epi32(ch, _mm256_set1_epi32(static_cast<int>(K[t]))), wt));
+            __m256i sigma0 = _mm256_xor_si256(_mm256_xor_si256(rotr8x(a, 2), rotr8x(a, 13)), rotr8x(a, 22));
+            __m256i maj = _mm256_or_si256(_mm256_and_si256(a, _mm256_or_si256(b, c)), _mm256_and_si256(b, c));
+            __m256i t2 = _mm256_add_epi32(sigma0, maj);
+            
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm256_add_epi32(t1, t2);
+        }
+        
+        s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+        s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+    }
+    
+    for (int j = 0; j < 8; j++) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), s[j]);
+        for (size_t lane = 0; lane < SHA256_AVX2_LANES; lane++) {
+            states[lane][j] = lanes[lane];
+        }
+    }
+}
+
+static bool cpuHasShaNi() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+        return false;
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ebx & bit_SHA) != 0;
+}
+
+static bool cpuHasAvx2() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) {
+        return false;
+    }
+    
+    // The OS must save the YMM registers
+    unsigned xcr0Low, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    (void)xcr0High;
+    if ((xcr0Low & 0x6) != 0x6) {
+        return false;
+    }
+    
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ebx & bit_AVX2) != 0;
+}
+
+#endif // ODIN4_SHA256_X86
+
+#ifdef ODIN4_SHA256_ARM
+
+// ARMv8 cryptography extensions, four rounds per sha256h/sha256h2 pair
+ODIN4_TARGET_ARM_SHA
+static void compressArmV8(uint32_t state[8], const unsigned char* data, size_t blocks) {
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+    
+    while (blocks--) {
+        uint32x4_t abcdSave = state0;
+        uint32x4_t efghSave = state1;
+        uint32x4_t w[4];
+        
+        for (int i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+            } else {
+                w[i & 3] = vsha256su1q_u32(vsha256su0q_u32(w[i & 3], w[(i + 1) & 3]),
+                                           w[(i + 2) & 3], w[(i + 3) & 3]);
+            }
+            
+            uint32x4_t msg = vaddq_u32(w[i & 3], vld1q_u32(&K[4 * i]));
+            uint32x4_t abcd = state0;
+            state0 = vsha256hq_u32(state0, state1, msg);
+            state1 = vsha256h2q_u32(state1, abcd, msg);
+        }
+        
+        state0 = vaddq_u32(state0, abcdSave);
+        state1 = vaddq_u32(state1, efghSave);
+        data += SHA256_BLOCK_SIZE;
+    }
+    
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+static bool cpuHasArmSha2() {
+#if defined(__APPLE__)
+    return true;    // Every Apple arm64 CPU has them
+#elif defined(__linux__) && defined(HWCAP_SHA2)
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif // ODIN4_SHA256_ARM
+
+// Dispatch
+
+static Sha256Kernel detectKernel() {
+    if (Sha256Engine::isSupported(Sha256Kernel::ShaNi)) {
+        return Sha256Kernel::ShaNi;
+    }
+    if (Sha256Engine::isSupported(Sha256Kernel::ArmV8)) {
+        return Sha256Kernel::ArmV8;
+    }
+    if (Sha256Engine::isSupported(Sha256Kernel::Avx2)) {
+        return Sha256Kernel::Avx2;
+    }
+    return Sha256Kernel::Portable;
+}
+
+static std::atomic<int>& selectedKernel() {
+    static std::atomic<int> kernel(static_cast<int>(detectKernel()));
+    return kernel;
+}
+
+Sha256Kernel Sha256Engine::getKernel() {
+    return static_cast<Sha256Kernel>(selectedKernel().load(std::memory_order_relaxed));
+}
+
+const char* Sha256Engine::kernelName(Sha256Kernel kernel) {
+    switch (kernel) {
+        case Sha256Kernel::ShaNi: return "sha-ni";
+        case Sha256Kernel::ArmV8: return "armv8";
+        case Sha256Kernel::Avx2: return "avx2";
+        case Sha256Kernel::Portable: break;
+    }
+    return "portable";
+}
+
+bool Sha256Engine::isSupported(Sha256Kernel kernel) {
+    switch (kernel) {
+        case Sha256Kernel::Portable:
+            return true;
+#ifdef ODIN4_SHA256_X86
+        case Sha256Kernel::ShaNi:
+            return cpuHasShaNi();
+        case Sha256Kernel::Avx2:
+            return cpuHasAvx2();
+#endif
+#ifdef ODIN4_SHA256_ARM
+        case Sha256Kernel::ArmV8:
+            return cpuHasArmSha2();
+#endif
+        default:
+            return false;
+    }
+}
+
+bool Sha256Engine::setKernel(Sha256Kernel kernel) {
+    if (!isSupported(kernel)) {
+        return false;
+    }
+    selectedKernel().store(static_cast<int>(kernel), std::memory_order_relaxed);
+    return true;
+}
+
+size_t Sha256Engine::getLanes() {
+    return getKernel() == Sha256Kernel::Avx2 ? SHA256_AVX2_LANES : 1;
+}
+
+void Sha256Engine::init(uint32_t state[8]) {
+    memcpy(state, H0, sizeof(H0));
+}
+
+void Sha256Engine::compress(uint32_t state[8], const unsigned char* data, size_t blocks) {
+    if (blocks == 0) {
+        return;
+    }
+    
+    switch (getKernel()) {
+#ifdef ODIN4_SHA256_X86
+        case Sha256Kernel::ShaNi:
+            compressShaNi(state, data, blocks);
+            return;
+#endif
+#ifdef ODIN4_SHA256_ARM
+        case Sha256Kernel::ArmV8:
+            compressArmV8(state, data, blocks);
+            return;
+#endif
+        default:
+            compressPortable(state, data, blocks);
+            return;
+    }
+}
+
+void Sha256Engine::finish(uint32_t state[8], const unsigned char* data, size_t size, uint64_t totalSize,
+                          unsigned char digest[SHA256_DIGEST_SIZE]) {
+    // The 0x80 marker and the 64-bit bit count may spill into a second block
+    unsigned char tail[2 * SHA256_BLOCK_SIZE] = {0};
+    memcpy(tail, data, size);
+    tail[size] = 0x80;
+    
+    size_t tailSize = size + 1 + 8 <= SHA256_BLOCK_SIZE ? SHA256_BLOCK_SIZE : 2 * SHA256_BLOCK_SIZE;
+    uint64_t bits = totalSize * 8;
+    for (int i = 0; i < 8; i++) {
+        tail[tailSize - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    compress(state, tail, tailSize / SHA256_BLOCK_SIZE);
+    
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = static_cast<unsigned char>(state[i] >> 24);
+        digest[4 * i + 1] = static_cast<unsigned char>(state[i] >> 16);
+        digest[4 * i + 2] = static_cast<unsigned char>(state[i] >> 8);
+        digest[4 * i + 3] = static_cast<unsigned char>(state[i]);
+    }
+}
+
+void Sha256Engine::digest(const unsigned char* data, size_t size, unsigned char digest[SHA256_DIGEST_SIZE]) {
+    uint32_t state[8];
+    init(state);
+    
+    size_t blocks = size / SHA256_BLOCK_SIZE;
+    compress(state, data, blocks);
+    finish(state, data + blocks * SHA256_BLOCK_SIZE, size % SHA256_BLOCK_SIZE, size, digest);
+}
+
+void Sha256Engine::digestMany(const unsigned char* const* data, const size_t* sizes, size_t count,
+                              unsigned char (*digests)[SHA256_DIGEST_SIZE]) {
+#ifdef ODIN4_SHA256_X86
+    if (getKernel() == Sha256Kernel::Avx2) {
+        for (size_t first = 0; first < count; first += SHA256_AVX2_LANES) {
+            size_t used = std::min(count - first, SHA256_AVX2_LANES);
+            
+            // Spare lanes repeat the first stream, their result is dropped
+            uint32_t laneStates[SHA256_AVX2_LANES][8];
+            uint32_t* states[SHA256_AVX2_LANES];
+            const unsigned char* inputs[SHA256_AVX2_LANES];
+            size_t common = ~static_cast<size_t>(0);
+            
+            for (size_t lane = 0; lane < SHA256_AVX2_LANES; lane++) {
+                size_t index = first + (lane < used ? lane : 0);
+                init(laneStates[lane]);
+                states[lane] = laneStates[lane];
+                inputs[lane] = data[index];
+                common = std::min(common, sizes[index] / SHA256_BLOCK_SIZE);
+            }
+            
+            // Blocks all lanes have run side by side, the rest one by one
+            compressAvx2(states, inputs, common);
+            
+            for (size_t lane = 0; lane < used; lane++) {
+                size_t index = first + lane;
+                size_t done = common * SHA256_BLOCK_SIZE;
+                size_t blocks = (sizes[index] - done) / SHA256_BLOCK_SIZE;
+                compress(states[lane], data[index] + done, blocks);
+                done += blocks * SHA256_BLOCK_SIZE;
+                finish(states[lane], data[index] + done, sizes[index] - done, sizes[index], digests[index]);
+            }
+        }
+        return;
+    }
+#endif
+    
+    for (size_t i = 0; i < count; i++) {
+        digest(data[i], sizes[i], digests[i]);
+    }
+}
+
+} // namespace Odin
@@ -4,9 +4,19 @@
  */
 
 #include "Tar.h"
+#include "Manifest.h"
 #include "Log.h"
 #include <cstring>
-#include <cstdio>
+#include <cerrno>
+#include <cstddef>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace Odin {
 
@@ -35,10 +45,99 @@ struct TarHeader {
 
 static_assert(sizeof(TarHeader) == 512, "TarHeader must be 512 bytes");
 
+// Sidecar layout (little-endian, the file travels with the archive):
+// [8 bytes] magic "ODINTIDX"
+// [4 bytes] format version
+// [8 bytes] archive size
+// [string]  SHA-256 of the first TAR_INDEX_PREFIX_SIZE bytes
+// [4 bytes] entry count, then per entry:
+//           name, size, offset, flags, mode, mtime, leading bytes, SHA-256
+// [4 bytes] CRC-32 of everything above
+// Strings are a 4-byte length followed by the bytes.
+static const char TAR_INDEX_MAGIC[8] = {'O', 'D', 'I', 'N', 'T', 'I', 'D', 'X'};
+constexpr uint32_t TAR_INDEX_VERSION = 1;
+constexpr uint64_t TAR_INDEX_PREFIX_SIZE = 64 * 1024;
+constexpr uint32_t TAR_INDEX_MAX_COUNT = 1 << 20;
+
+static void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void putU64(std::string& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void putString(std::string& out, const std::string& value) {
+    putU32(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+namespace {
+
+// Bounds-checked reader over a loaded sidecar
+class IndexReader {
+public:
+    IndexReader(const std::string& data, size_t end) : data_(data), end_(end), pos_(0) {}
+    
+    bool bytes(char* out, size_t size) {
+        if (size > end_ - pos_) {
+            return false;
+        }
+        memcpy(out, data_.data() + pos_, size);
+        pos_ += size;
+        return true;
+    }
+    
+    bool u32(uint32_t& value) {
+        unsigned char raw[4];
+        if (!bytes(reinterpret_cast<char*>(raw), sizeof(raw))) {
+            return false;
+        }
+        value = 0;
+        for (int i = 3; i >= 0; i--) {
+            value = (value << 8) | raw[i];
+        }
+        return true;
+    }
+    
+    bool u64(uint64_t& value) {
+        unsigned char raw[8];
+        if (!bytes(reinterpret_cast<char*>(raw), sizeof(raw))) {
+            return false;
+        }
+        value = 0;
+        for (int i = 7; i >= 0; i--) {
+            value = (value << 8) | raw[i];
+        }
+        return true;
+    }
+    
+    bool string(std::string& value) {
+        uint32_t length = 0;
+        if (!u32(length) || length > end_ - pos_) {
+            return false;
+        }
+        value.assign(data_.data() + pos_, length);
+        pos_ += length;
+        return true;
+    }
+
+private:
+    const std::string& data_;
+    size_t end_;
+    size_t pos_;
+};
+
+} // namespace
+
 Tar::Tar(const std::string& path)
     : path_(path)
-    , file_(nullptr)
-    , isOpen_(false)
+    , fd_(-1)
+    , indexed_(false)
 {
 }
 
@@ -47,69 +146,363 @@ Tar::~Tar() {
 }
 
 bool Tar::open() {
-    if (isOpen_) {
+    if (fd_ >= 0) {
         return true;
     }
     
-    file_ = fopen(path_.c_str(), "rb");
-    if (!file_) {
+    fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
         Log::error(TAG, "Failed to open: " + path_);
         return false;
     }
     
-    isOpen_ = true;
     entries_.clear();
     
-    // Parse TAR entries
-    TarHeader header;
-    size_t currentOffset = 0;
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        Log::error(TAG, "Failed to stat: " + path_);
+        close();
+        return false;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(st.st_size);
     
-    while (fread(&header, sizeof(header), 1, file_) == 1) {
-        // Check for end of archive (two zero blocks)
-        bool isEmpty = true;
-        for (size_t i = 0; i < sizeof(header); i++) {
-            if (reinterpret_cast<char*>(&header)[i] != 0) {
-                isEmpty = false;
+    if (loadIndex(fileSize)) {
+        buildLookup();
+        Log::info(TAG, "Indexed " + std::to_string(entries_.size()) + " entries from " + indexPath(path_));
+        return true;
+    }
+    
+    bool valid = true;
+    
+    // Scan the headers through a mapping: only the pages holding headers
+    // are faulted in, and no read or seek is issued per entry
+    void* view = MAP_FAILED;
+    if (fileSize >= sizeof(TarHeader)) {
+        view = mmap(nullptr, static_cast<size_t>(fileSize), PROT_READ, MAP_PRIVATE, fd_, 0);
+    }
+    
+    if (view != MAP_FAILED) {
+        // Headers are sparse; readahead would pull in the payloads too
+        madvise(view, static_cast<size_t>(fileSize), MADV_RANDOM);
+        
+        const char* data = static_cast<const char*>(view);
+        uint64_t offset = 0;
+        bool end = false;
+        while (!end && valid) {
+            if (offset == fileSize) {
+                break;      // No end blocks, but nothing cut short either
+            }
+            if (offset > fileSize - sizeof(TarHeader)) {
+                Log::error(TAG, "Truncated TAR header at offset " + std::to_string(offset));
+                valid = false;
                 break;
             }
+            valid = indexHeader(data + offset, offset, fileSize, offset, end);
         }
         
-        if (isEmpty) {
-            break;
+        munmap(view, static_cast<size_t>(fileSize));
+    } else {
+        // Unmappable (or tiny) file: fall back to one buffered block at a time
+        char block[sizeof(TarHeader)];
+        uint64_t offset = 0;
+        bool end = false;
+        while (!end && valid && offset != fileSize) {
+            if (!readAt(offset, block, sizeof(block))) {
+                Log::error(TAG, "Truncated TAR header at offset " + std::to_string(offset));
+                valid = false;
+                break;
+            }
+            valid = indexHeader(block, offset, fileSize, offset, end);
         }
-        
-        TarEntry entry;
-        if (!parseHeader(reinterpret_cast<char*>(&header), entry)) {
-            Log::error(TAG, "Failed to parse TAR header");
-            break;
+    }
+    
+    // A partial entry table would flash a subset of the images
+    if (!valid) {
+        entries_.clear();
+        buildLookup();
+        close();
+        return false;
+    }
+    
+    buildLookup();
+    Log::info(TAG, "Parsed " + std::to_string(entries_.size()) + " entries");
+    return true;
+}
+
+bool Tar::indexHeader(const char* block, uint64_t offset, uint64_t fileSize, uint64_t& next, bool& end) {
+    // End of archive (two zero blocks)
+    if (isZeroBlock(block)) {
+        end = true;
+        return true;
+    }
+    
+    TarEntry entry;
+    if (!parseHeader(block, entry)) {
+        Log::error(TAG, "Invalid TAR header at offset " + std::to_string(offset));
+        return false;
+    }
+    
+    // Data follows the header, padded to 512 bytes
+    entry.offset = offset + sizeof(TarHeader);
+    if (entry.size > fileSize - entry.offset) {
+        Log::error(TAG, "TAR entry truncated: " + entry.name);
+        return false;
+    }
+    next = std::min(fileSize, entry.offset + (entry.size + 511) / 512 * 512);
+    
+    if (entry.isFile && entry.size > 0) {
+        entries_.push_back(entry);
+    }
+    
+    return true;
+}
+
+bool Tar::open(const std::vector<TarEntry>& entries) {
+    close();
+    
+    fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        Log::error(TAG, "Failed to open: " + path_);
+        return false;
+    }
+    
+    entries_ = entries;
+    buildLookup();
+    return true;
+}
+
+void Tar::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    
+    indexed_ = false;
+    heads_.clear();
+    digests_.clear();
+}
+
+std::string Tar::indexPath(const std::string& path) {
+    return path + ".odinidx";
+}
+
+bool Tar::hashPrefix(uint64_t fileSize, std::string& digest) const {
+    std::string prefix(static_cast<size_t>(std::min(fileSize, TAR_INDEX_PREFIX_SIZE)), '\0');
+    if (!readAt(0, &prefix[0], prefix.size())) {
+        return false;
+    }
+    
+    digest = Manifest::calculateSHA256(prefix.data(), prefix.size());
+    return !digest.empty();
+}
+
+bool Tar::loadIndex(uint64_t fileSize) {
+    std::ifstream in(indexPath(path_), std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    
+    std::stringstream contents;
+    contents << in.rdbuf();
+    const std::string data = contents.str();
+    
+    // Checked before anything else so a torn write is never trusted
+    if (data.size() < sizeof(TAR_INDEX_MAGIC) + 4) {
+        return false;
+    }
+    size_t bodySize = data.size() - 4;
+    uint32_t storedCrc = 0;
+    for (int i = 3; i >= 0; i--) {
+        storedCrc = (storedCrc << 8) | static_cast<unsigned char>(data[bodySize + i]);
+    }
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(data.data()), static_cast<uInt>(bodySize));
+    
+    IndexReader reader(data, bodySize);
+    char magic[sizeof(TAR_INDEX_MAGIC)];
+    uint32_t version = 0;
+    uint64_t archiveSize = 0;
+    std::string prefixDigest;
+    if (static_cast<uint32_t>(crc) != storedCrc ||
+        !reader.bytes(magic, sizeof(magic)) || memcmp(magic, TAR_INDEX_MAGIC, sizeof(magic)) != 0 ||
+        !reader.u32(version) || version != TAR_INDEX_VERSION ||
+        !reader.u64(archiveSize) || !reader.string(prefixDigest)) {
+        Log::info(TAG, "Ignoring unreadable index: " + indexPath(path_));
+        return false;
+    }
+    
+    std::string actualDigest;
+    if (archiveSize != fileSize || !hashPrefix(fileSize, actualDigest) || actualDigest != prefixDigest) {
+        Log::info(TAG, "Ignoring stale index: " + indexPath(path_));
+        return false;
+    }
+    
+    uint32_t entryCount = 0;
+    if (!reader.u32(entryCount) || entryCount > TAR_INDEX_MAX_COUNT) {
+        return false;
+    }
+    
+    std::vector<TarEntry> entries(entryCount);
+    std::vector<std::string> heads(entryCount);
+    std::vector<std::string> digests(entryCount);
+    uint64_t end = 0;
+    for (uint32_t i = 0; i < entryCount; i++) {
+        TarEntry& entry = entries[i];
+        uint32_t flags = 0;
+        if (!reader.string(entry.name) || !reader.u64(entry.size) || !reader.u64(entry.offset) ||
+            !reader.u32(flags) || !reader.u32(entry.mode) || !reader.u32(entry.mtime) ||
+            !reader.string(heads[i]) || !reader.string(digests[i])) {
+            return false;
         }
+        entry.isFile = (flags & 0x01) != 0;
+        entry.isDirectory = (flags & 0x02) != 0;
         
-        // Record the data offset (after this header)
-        entry.offset = currentOffset + sizeof(TarHeader);
+        // In archive order, block aligned and inside the file
+        if (entry.offset < end + sizeof(TarHeader) || entry.offset % sizeof(TarHeader) != 0 ||
+            entry.offset > fileSize || entry.size > fileSize - entry.offset ||
+            heads[i].size() > entry.size) {
+            Log::info(TAG, "Ignoring inconsistent index: " + indexPath(path_));
+            return false;
+        }
+        end = entry.offset + entry.size;
+    }
+    
+    // The prefix only covers the first entries; check the last header too
+    if (!entries.empty()) {
+        const TarEntry& last = entries.back();
+        char block[sizeof(TarHeader)];
+        TarEntry parsed;
+        if (!readAt(last.offset - sizeof(TarHeader), block, sizeof(block)) ||
+            !parseHeader(block, parsed) || parsed.name != last.name || parsed.size != last.size) {
+            Log::info(TAG, "Ignoring stale index: " + indexPath(path_));
+            return false;
+        }
+    }
+    
+    entries_ = std::move(entries);
+    heads_ = std::move(heads);
+    digests_ = std::move(digests);
+    indexed_ = true;
+    return true;
+}
+
+bool Tar::writeIndex() {
+    if (fd_ < 0) {
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        return false;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+    
+    std::string prefixDigest;
+    if (!hashPrefix(fileSize, prefixDigest)) {
+        Log::error(TAG, "Failed to read: " + path_);
+        return false;
+    }
+    
+    std::vector<std::string> heads(entries_.size());
+    std::vector<std::string> digests(entries_.size());
+    
+    std::string data(TAR_INDEX_MAGIC, sizeof(TAR_INDEX_MAGIC));
+    putU32(data, TAR_INDEX_VERSION);
+    putU64(data, fileSize);
+    putString(data, prefixDigest);
+    putU32(data, static_cast<uint32_t>(entries_.size()));
+    
+    for (size_t i = 0; i < entries_.size(); i++) {
+        const TarEntry& entry = entries_[i];
         
-        // Add to entries list
-        if (entry.isFile && entry.size > 0) {
-            entries_.push_back(entry);
+        std::string& head = heads[i];
+        head.assign(static_cast<size_t>(std::min<uint64_t>(entry.size, LZ4_HEADER_PROBE_SIZE)), '\0');
+        if (!readAt(entry.offset, &head[0], head.size())) {
+            Log::error(TAG, "Read failed: " + entry.name);
+            return false;
         }
         
-        // Skip to next header (align to 512 bytes)
-        size_t dataBlocks = (entry.size + 511) / 512;
-        size_t skipBytes = dataBlocks * 512;
+        // Digests already in a valid sidecar are kept
+        std::string& digest = digests[i];
+        digest = (i < digests_.size()) ? digests_[i] : "";
+        if (digest.empty()) {
+            std::unique_ptr<ByteSource> source = ByteSource::openFile(path_, ReadMode::Buffered,
+                                                                      entry.offset, entry.size);
+            digest = source ? Manifest::calculateSHA256(*source) : "";
+            if (digest.empty()) {
+                Log::error(TAG, "Failed to hash: " + entry.name);
+                return false;
+            }
+        }
         
-        fseek(file_, static_cast<long>(skipBytes), SEEK_CUR);
-        currentOffset += sizeof(TarHeader) + skipBytes;
+        uint32_t flags = (entry.isFile ? 0x01 : 0) | (entry.isDirectory ? 0x02 : 0);
+        putString(data, entry.name);
+        putU64(data, entry.size);
+        putU64(data, entry.offset);
+        putU32(data, flags);
+        putU32(data, entry.mode);
+        putU32(data, entry.mtime);
+        putString(data, head);
+        putString(data, digest);
     }
     
-    Log::info(TAG, "Parsed " + std::to_string(entries_.size()) + " entries");
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(data.data()), static_cast<uInt>(data.size()));
+    putU32(data, static_cast<uint32_t>(crc));
+    
+    // Write to a temporary file and rename so a concurrent open() never
+    // sees a half-written sidecar
+    std::string finalPath = indexPath(path_);
+    std::string tempPath = finalPath + ".tmp" + std::to_string(getpid());
+    
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        Log::error(TAG, "Cannot write index: " + tempPath);
+        return false;
+    }
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.close();
+    
+    if (!out || rename(tempPath.c_str(), finalPath.c_str()) != 0) {
+        Log::error(TAG, "Failed to write index: " + finalPath);
+        unlink(tempPath.c_str());
+        return false;
+    }
+    
+    heads_ = std::move(heads);
+    digests_ = std::move(digests);
+    
+    Log::info(TAG, "Wrote index: " + finalPath);
     return true;
 }
 
-void Tar::close() {
-    if (file_) {
-        fclose(file_);
-        file_ = nullptr;
+size_t Tar::findIndex(const TarEntry& entry) const {
+    // entries_ is in archive order, so offsets are ascending
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), entry.offset,
+                               [](const TarEntry& e, uint64_t offset) { return e.offset < offset; });
+    if (it == entries_.end() || it->offset != entry.offset) {
+        return entries_.size();
     }
-    isOpen_ = false;
+    return static_cast<size_t>(it - entries_.begin());
+}
+
+std::string Tar::getEntryDigest(const TarEntry& entry) const {
+    size_t index = findIndex(entry);
+    return index < digests_.size() ? digests_[index] : "";
+}
+
+bool Tar::readAt(uint64_t offset, char* buffer, size_t size) const {
+    while (size > 0) {
+        ssize_t bytesRead = pread(fd_, buffer, size, static_cast<off_t>(offset));
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            return false;
+        }
+        buffer += bytesRead;
+        offset += static_cast<uint64_t>(bytesRead);
+        size -= static_cast<size_t>(bytesRead);
+    }
+    return true;
 }
 
 bool Tar::parseHeader(const char* data, TarEntry& entry) {
@@ -123,6 +516,10 @@ bool Tar::parseHeader(const char* data, TarEntry& entry) {
         }
     }
     
+    if (!verifyChecksum(data)) {
+        return false;
+    }
+    
     // Get name (may include prefix)
     if (header->prefix[0] != '\0') {
         entry.name = std::string(header->prefix, strnlen(header->prefix, 155));
@@ -161,8 +558,41 @@ bool Tar::parseHeader(const char* data, TarEntry& entry) {
     return true;
 }
 
-size_t Tar::octalToDecimal(const char* str, size_t len) {
-    size_t result = 0;
+bool Tar::isZeroBlock(const char* block) {
+    // OR whole words together; compilers turn this into vector loads
+    uint64_t bits = 0;
+    for (size_t i = 0; i < sizeof(TarHeader); i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, block + i, sizeof(word));
+        bits |= word;
+    }
+    return bits == 0;
+}
+
+bool Tar::verifyChecksum(const char* block) {
+    const TarHeader* header = reinterpret_cast<const TarHeader*>(block);
+    uint64_t stored = octalToDecimal(header->checksum, sizeof(header->checksum));
+    
+    // The checksum field counts as eight spaces. Old writers summed
+    // signed chars, so accept either interpretation.
+    uint32_t unsignedSum = 0;
+    int32_t signedSum = 0;
+    for (size_t i = 0; i < sizeof(TarHeader); i++) {
+        unsignedSum += static_cast<unsigned char>(block[i]);
+        signedSum += static_cast<signed char>(block[i]);
+    }
+    
+    const size_t checksumOffset = offsetof(TarHeader, checksum);
+    for (size_t i = 0; i < sizeof(header->checksum); i++) {
+        unsignedSum += ' ' - static_cast<unsigned char>(block[checksumOffset + i]);
+        signedSum += ' ' - static_cast<signed char>(block[checksumOffset + i]);
+    }
+    
+    return stored == unsignedSum || static_cast<int64_t>(stored) == signedSum;
+}
+
+uint64_t Tar::octalToDecimal(const char* str, size_t len) {
+    uint64_t result = 0;
     
     for (size_t i = 0; i < len && str[i] != '\0' && str[i] != ' '; i++) {
         if (str[i] >= '0' && str[i] <= '7') {
@@ -173,26 +603,43 @@ size_t Tar::octalToDecimal(const char* str, size_t len) {
     return result;
 }
 
-const TarEntry* Tar::findEntry(const std::string& name) const {
-    for (const auto& entry : entries_) {
-        if (entry.name == name) {
-            return &entry;
-        }
+void Tar::buildLookup() {
+    byName_.clear();
+    byBasename_.clear();
+    byName_.reserve(entries_.size());
+    byBasename_.reserve(entries_.size());
+    
+    for (size_t i = 0; i < entries_.size(); i++) {
+        const std::string& name = entries_[i].name;
+        byName_.emplace(name, i);
         
-        // Also try matching just the filename
-        size_t lastSlash = entry.name.find_last_of('/');
+        size_t lastSlash = name.find_last_of('/');
         if (lastSlash != std::string::npos) {
-            if (entry.name.substr(lastSlash + 1) == name) {
-                return &entry;
-            }
+            byBasename_.emplace(name.substr(lastSlash + 1), i);
         }
     }
+}
+
+const TarEntry* Tar::findEntry(const std::string& name) const {
+    // Same answer as trying both matches on each entry in turn: the
+    // earlier of the two hits
+    size_t found = entries_.size();
+    
+    auto it = byName_.find(name);
+    if (it != byName_.end()) {
+        found = it->second;
+    }
     
-    return nullptr;
+    it = byBasename_.find(name);
+    if (it != byBasename_.end()) {
+        found = std::min(found, it->second);
+    }
+    
+    return found < entries_.size() ? &entries_[found] : nullptr;
 }
 
 bool Tar::readEntry(const TarEntry& entry, char* buffer, size_t bufferSize) const {
-    if (!file_ || !isOpen_) {
+    if (fd_ < 0) {
         return false;
     }
     
@@ -201,22 +648,34 @@ bool Tar::readEntry(const TarEntry& entry, char* buffer, size_t bufferSize) cons
         return false;
     }
     
-    // Seek to data offset
-    if (fseek(file_, static_cast<long>(entry.offset), SEEK_SET) != 0) {
-        Log::error(TAG, "Seek failed");
+    if (!readAt(entry.offset, buffer, static_cast<size_t>(entry.size))) {
+        Log::error(TAG, "Read failed: " + entry.name);
         return false;
     }
     
-    // Read data
-    size_t bytesRead = fread(buffer, 1, entry.size, file_);
+    return true;
+}
+
+bool Tar::readEntryRange(const TarEntry& entry, uint64_t offset, char* buffer, size_t size) const {
+    if (fd_ < 0) {
+        return false;
+    }
     
-    if (bytesRead != entry.size) {
-        Log::error(TAG, "Read failed: " + std::to_string(bytesRead) + "/" + 
-                   std::to_string(entry.size));
+    if (offset > entry.size || size > entry.size - offset) {
+        Log::error(TAG, "Range outside entry: " + entry.name);
         return false;
     }
     
-    return true;
+    // Leading bytes recorded in the sidecar need no I/O
+    if (indexed_) {
+        size_t index = findIndex(entry);
+        if (index < heads_.size() && offset + size <= heads_[index].size()) {
+            memcpy(buffer, heads_[index].data() + offset, size);
+            return true;
+        }
+    }
+    
+    return readAt(entry.offset + offset, buffer, size);
 }
 
 void Tar::forEach(EntryCallback callback) const {
@@ -227,4 +686,103 @@ void Tar::forEach(EntryCallback callback) const {
     }
 }
 
+// TarStream
+
+TarStream::TarStream(std::unique_ptr<ByteSource> source)
+    : source_(std::move(source))
+    , payload_(*source_)
+    , padding_(0)
+    , finished_(false)
+    , error_(false)
+{
+}
+
+bool TarStream::next(TarEntry& entry) {
+    if (finished_ || error_) {
+        return false;
+    }
+    
+    // Whatever the caller did not read of the last payload, plus padding
+    if (!source_->skip(payload_.remaining() + padding_)) {
+        Log::error(Tar::TAG, "Truncated TAR stream");
+        error_ = true;
+        return false;
+    }
+    payload_.reset(0);
+    padding_ = 0;
+    
+    char block[512];
+    ssize_t blockSize = source_->readUpTo(block, sizeof(block));
+    if (blockSize == 0) {
+        // No end-of-archive blocks, tolerated like tar does
+        finished_ = true;
+        return false;
+    }
+    if (blockSize != static_cast<ssize_t>(sizeof(block))) {
+        Log::error(Tar::TAG, "Truncated TAR header");
+        error_ = true;
+        return false;
+    }
+    
+    if (Tar::isZeroBlock(block)) {
+        finished_ = true;
+        return false;
+    }
+    
+    if (!Tar::parseHeader(block, entry)) {
+        Log::error(Tar::TAG, "Invalid TAR header at offset " +
+                   std::to_string(source_->position() - sizeof(block)));
+        error_ = true;
+        return false;
+    }
+    
+    entry.offset = source_->position();
+    payload_.reset(entry.size);
+    padding_ = (entry.size + 511) / 512 * 512 - entry.size;
+    return true;
+}
+
+bool TarStream::drain() {
+    if (error_) {
+        return false;
+    }
+    
+    if (source_->size() != BYTE_SOURCE_UNKNOWN_SIZE) {
+        return source_->skip(source_->size() - source_->position());
+    }
+    
+    char scratch[0x10000];
+    ssize_t bytesRead;
+    while ((bytesRead = source_->read(scratch, sizeof(scratch))) > 0) {
+    }
+    return bytesRead == 0;
+}
+
+ssize_t TarStream::PayloadSource::read(char* buffer, size_t size) {
+    size = static_cast<size_t>(std::min<uint64_t>(size, remaining()));
+    if (size == 0) {
+        return 0;
+    }
+    
+    ssize_t bytesRead = upstream_.read(buffer, size);
+    if (bytesRead < 0) {
+        return -1;
+    }
+    if (bytesRead == 0) {
+        Log::error(Tar::TAG, "TAR entry truncated");
+        return -1;
+    }
+    
+    position_ += static_cast<uint64_t>(bytesRead);
+    return bytesRead;
+}
+
+bool TarStream::PayloadSource::skip(uint64_t bytes) {
+    if (bytes > remaining() || !upstream_.skip(bytes)) {
+        return false;
+    }
+    position_ += bytes;
+    return true;
+}
+
 } // namespace Odin
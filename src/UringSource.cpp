@@ -0,0 +1,498 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * UringSource - io_uring file stage implementation
+ */
+
+#include "UringSource.h"
+#include "Log.h"
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <unistd.h>
+
+// Raw system calls against the kernel UAPI header, no liburing needed
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ODIN4_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace Odin {
+
+const std::string UringSource::TAG = "UringSource";
+
+#ifdef ODIN4_HAVE_IO_URING
+
+// Reads in flight per source and bytes per read
+constexpr unsigned URING_QUEUE_DEPTH = 4;
+constexpr size_t URING_READ_SIZE = 0x100000;  // 1MB
+
+// Buffers are page aligned, as registered buffers prefer
+constexpr size_t URING_BUFFER_ALIGNMENT = 4096;
+
+// user_data of cancel requests; slot reads use the slot index
+constexpr uint64_t URING_CANCEL_TAG = ~static_cast<uint64_t>(0);
+
+static int uringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uringEnter(int ring, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static int uringRegister(int ring, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ring, opcode, arg, count));
+}
+
+std::unique_ptr<UringSource> UringSource::open(int fd, uint64_t offset, uint64_t length) {
+    std::unique_ptr<UringSource> source(new UringSource(fd, offset, length));
+    if (!source->setup()) {
+        // The caller keeps the descriptor for its fallback
+        source->fd_ = -1;
+        return nullptr;
+    }
+    return source;
+}
+
+UringSource::UringSource(int fd, uint64_t offset, uint64_t length)
+    : fd_(fd)
+    , offset_(offset)
+    , length_(length)
+    , position_(0)
+    , nextOffset_(0)
+    , failed_(false)
+    , closing_(false)
+    , cache_(nullptr)
+    , ring_(-1)
+    , sqRing_(nullptr)
+    , sqRingSize_(0)
+    , cqRing_(nullptr)
+    , cqRingSize_(0)
+    , sqes_(nullptr)
+    , sqesSize_(0)
+    , sqHead_(nullptr)
+    , sqTail_(nullptr)
+    , sqMask_(nullptr)
+    , sqArray_(nullptr)
+    , cqHead_(nullptr)
+    , cqTail_(nullptr)
+    , cqMask_(nullptr)
+    , cqes_(nullptr)
+    , pending_(0)
+    , fixedFile_(false)
+    , fixedBuffers_(false)
+    , slotSize_(0)
+    , head_(0)
+    , buffers_(nullptr)
+{
+}
+
+UringSource::~UringSource() {
+    // The kernel may still be writing into the slots. Closing the ring
+    // does not wait for that, so cancel and collect every read first; if
+    // even that fails the buffers are leaked rather than freed under it.
+    bool idle = true;
+    if (ring_ >= 0 && !slots_.empty()) {
+        closing_ = true;
+        idle = cancel() && drain();
+        if (!idle) {
+            Log::error(TAG, "Reads still in flight, leaking their buffers");
+        }
+    }
+    
+    if (sqes_) {
+        munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ && cqRing_ != sqRing_) {
+        munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_) {
+        munmap(sqRing_, sqRingSize_);
+    }
+    if (ring_ >= 0) {
+        ::close(ring_);
+    }
+    if (idle) {
+        free(buffers_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool UringSource::setup() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    
+    ring_ = uringSetup(URING_QUEUE_DEPTH, &params);
+    if (ring_ < 0) {
+        Log::debug(TAG, "io_uring_setup failed: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    // Map the submission and completion rings (one mapping on 5.4+)
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    
+    void* sq = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        return false;
+    }
+    sqRing_ = sq;
+    
+    if (singleMmap) {
+        cqRing_ = sqRing_;
+    } else {
+        void* cq = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            return false;
+        }
+        cqRing_ = cq;
+    }
+    
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    sqes_ = sqes;
+    
+    char* sqBase = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sqBase + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sqBase + params.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned*>(sqBase + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sqBase + params.sq_off.array);
+    
+    char* cqBase = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cqBase + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cqBase + params.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned*>(cqBase + params.cq_off.ring_mask);
+    cqes_ = cqBase + params.cq_off.cqes;
+    
+    // One aligned block of slots, sized down for small payloads
+    slotSize_ = static_cast<size_t>(std::min<uint64_t>(
+        URING_READ_SIZE, (length_ + URING_BUFFER_ALIGNMENT - 1) / URING_BUFFER_ALIGNMENT * URING_BUFFER_ALIGNMENT));
+    slotSize_ = std::max(slotSize_, URING_BUFFER_ALIGNMENT);
+    size_t slotCount = static_cast<size_t>(std::min<uint64_t>(
+        std::min(URING_QUEUE_DEPTH, params.sq_entries), std::max<uint64_t>(1, (length_ + slotSize_ - 1) / slotSize_)));
+    
+    void* memory = nullptr;
+    if (posix_memalign(&memory, URING_BUFFER_ALIGNMENT, slotSize_ * slotCount) != 0) {
+        Log::error(TAG, "Cannot allocate read buffers");
+        return false;
+    }
+    buffers_ = static_cast<char*>(memory);
+    
+    slots_.resize(slotCount);
+    iovecs_.resize(slotCount);
+    for (size_t i = 0; i < slotCount; i++) {
+        slots_[i].buffer = buffers_ + i * slotSize_;
+        slots_[i].offset = 0;
+        slots_[i].length = 0;
+        slots_[i].filled = 0;
+        slots_[i].consumed = 0;
+        slots_[i].state = SlotState::Idle;
+        iovecs_[i].iov_base = slots_[i].buffer;
+        iovecs_[i].iov_len = slotSize_;
+    }
+    
+    // Registration saves per-request page pinning and fd lookups, but
+    // RLIMIT_MEMLOCK or an older kernel may refuse it; plain reads work too
+    fixedBuffers_ = uringRegister(ring_, IORING_REGISTER_BUFFERS, iovecs_.data(),
+                                  static_cast<unsigned>(slotCount)) == 0;
+    fixedFile_ = uringRegister(ring_, IORING_REGISTER_FILES, &fd_, 1) == 0;
+    
+    Log::debug(TAG, "Queue depth " + std::to_string(slotCount) + " x " + std::to_string(slotSize_) +
+               " bytes" + (fixedBuffers_ ? ", fixed buffers" : "") + (fixedFile_ ? ", fixed file" : ""));
+    
+    for (size_t i = 0; i < slotCount; i++) {
+        if (!queue(i)) {
+            return false;
+        }
+    }
+    
+    return submit(false);
+}
+
+bool UringSource::queue(size_t index) {
+    Slot& slot = slots_[index];
+    
+    if (nextOffset_ >= length_) {
+        slot.state = SlotState::Idle;
+        return true;
+    }
+    
+    slot.offset = nextOffset_;
+    slot.length = static_cast<size_t>(std::min<uint64_t>(slotSize_, length_ - nextOffset_));
+    slot.filled = 0;
+    slot.consumed = 0;
+    slot.state = SlotState::InFlight;
+    nextOffset_ += slot.length;
+    
+    return submitRead(index);
+}
+
+bool UringSource::submitRead(size_t index) {
+    Slot& slot = slots_[index];
+    
+    // At most one request per slot is outstanding, so the queue (sized
+    // to the slot count) cannot overflow
+    unsigned tail = *sqTail_;
+    unsigned ringIndex = tail & *sqMask_;
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes_) + ringIndex;
+    memset(sqe, 0, sizeof(*sqe));
+    
+    // A short read is continued from where it stopped
+    char* target = slot.buffer + slot.filled;
+    size_t length = slot.length - slot.filled;
+    
+    if (fixedBuffers_) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = reinterpret_cast<uintptr_t>(target);
+        sqe->len = static_cast<uint32_t>(length);
+        sqe->buf_index = static_cast<uint16_t>(index);
+    } else {
+        iovecs_[index].iov_base = target;
+        iovecs_[index].iov_len = length;
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = reinterpret_cast<uintptr_t>(&iovecs_[index]);
+        sqe->len = 1;
+    }
+    
+    if (fixedFile_) {
+        sqe->fd = 0;
+        sqe->flags = IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = fd_;
+    }
+    
+    sqe->off = offset_ + slot.offset + slot.filled;
+    sqe->user_data = index;
+    
+    sqArray_[ringIndex] = ringIndex;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    pending_++;
+    return true;
+}
+
+bool UringSource::submit(bool wait) {
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    
+    for (;;) {
+        int submitted = uringEnter(ring_, pending_, wait ? 1 : 0, flags);
+        if (submitted < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Log::error(TAG, "io_uring_enter failed: " + std::string(strerror(errno)));
+            return false;
+        }
+        pending_ -= std::min(static_cast<unsigned>(submitted), pending_);
+        return true;
+    }
+}
+
+bool UringSource::reap() {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    bool ok = true;
+    
+    while (head != tail) {
+        const struct io_uring_cqe* cqe = static_cast<const struct io_uring_cqe*>(cqes_) + (head & *cqMask_);
+        uint64_t userData = cqe->user_data;
+        int result = cqe->res;
+        head++;
+        
+        if (userData == URING_CANCEL_TAG) {
+            continue;
+        }
+        
+        Slot& slot = slots_[static_cast<size_t>(userData)];
+        if (closing_) {
+            slot.state = SlotState::Idle;
+            continue;
+        }
+        
+        if (result <= 0) {
+            Log::error(TAG, result < 0 ? "Read failed: " + std::string(strerror(-result))
+                                       : std::string("File shorter than expected"));
+            slot.state = SlotState::Idle;
+            ok = false;
+            continue;
+        }
+        
+        slot.filled += static_cast<size_t>(result);
+        if (slot.filled < slot.length) {
+            size_t index = static_cast<size_t>(userData);
+            submitRead(index);
+        } else {
+            slot.state = SlotState::Ready;
+        }
+    }
+    
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    
+    if (pending_ > 0 && !submit(false)) {
+        return false;
+    }
+    return ok;
+}
+
+bool UringSource::cancel() {
+    // Push out anything still queued so the submission ring has room
+    if (pending_ > 0 && !submit(false)) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < slots_.size(); i++) {
+        if (slots_[i].state != SlotState::InFlight) {
+            continue;
+        }
+        
+        unsigned tail = *sqTail_;
+        unsigned ringIndex = tail & *sqMask_;
+        struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes_) + ringIndex;
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = i;                  // user_data of the read to cancel
+        sqe->user_data = URING_CANCEL_TAG;
+        
+        sqArray_[ringIndex] = ringIndex;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        pending_++;
+    }
+    
+    return pending_ == 0 || submit(false);
+}
+
+bool UringSource::drain() {
+    for (const auto& slot : slots_) {
+        while (slot.state == SlotState::InFlight) {
+            if (!submit(true) || !reap()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+ssize_t UringSource::read(char* buffer, size_t size) {
+    if (failed_) {
+        return -1;
+    }
+    
+    size = static_cast<size_t>(std::min<uint64_t>(size, length_ - position_));
+    if (size == 0) {
+        return 0;
+    }
+    
+    Slot& slot = slots_[head_];
+    while (slot.state == SlotState::InFlight) {
+        if (!submit(true) || !reap()) {
+            failed_ = true;
+            return -1;
+        }
+    }
+    
+    if (slot.state != SlotState::Ready) {
+        failed_ = true;
+        return -1;
+    }
+    
+    size_t count = std::min(size, slot.filled - slot.consumed);
+    memcpy(buffer, slot.buffer + slot.consumed, count);
+    slot.consumed += count;
+    position_ += count;
+    if (cache_) {
+        cache_->advance(offset_ + position_);
+    }
+    
+    // Hand a drained slot straight back to the kernel
+    if (slot.consumed == slot.filled) {
+        size_t index = head_;
+        head_ = (head_ + 1) % slots_.size();
+        if (!queue(index) || !submit(false)) {
+            failed_ = true;
+            return -1;
+        }
+    }
+    
+    return static_cast<ssize_t>(count);
+}
+
+bool UringSource::skip(uint64_t bytes) {
+    if (failed_ || bytes > length_ - position_) {
+        return false;
+    }
+    
+    // Within the current slot: just advance
+    Slot& slot = slots_[head_];
+    if (slot.state == SlotState::Ready && bytes < slot.filled - slot.consumed) {
+        slot.consumed += static_cast<size_t>(bytes);
+        position_ += bytes;
+        return true;
+    }
+    
+    // Otherwise let the queued reads finish and restart at the target
+    if (!drain()) {
+        failed_ = true;
+        return false;
+    }
+    
+    position_ += bytes;
+    nextOffset_ = position_;
+    head_ = 0;
+    
+    for (size_t i = 0; i < slots_.size(); i++) {
+        if (!queue(i)) {
+            failed_ = true;
+            return false;
+        }
+    }
+    
+    if (!submit(false)) {
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+#else // !ODIN4_HAVE_IO_URING
+
+std::unique_ptr<UringSource> UringSource::open(int fd, uint64_t offset, uint64_t length) {
+    (void)fd;
+    (void)offset;
+    (void)length;
+    return nullptr;
+}
+
+UringSource::~UringSource() {
+}
+
+ssize_t UringSource::read(char* buffer, size_t size) {
+    (void)buffer;
+    (void)size;
+    return -1;
+}
+
+bool UringSource::skip(uint64_t bytes) {
+    (void)bytes;
+    return false;
+}
+
+#endif // ODIN4_HAVE_IO_URING
+
+} // namespace Odin
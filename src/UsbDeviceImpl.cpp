@@ -290,12 +290,12 @@ void UsbDeviceImpl::checkProductName(uint8_t productIndex) {
         return;
     }
     
-    std::string product(reinterpret_cast<char*>(buffer), len);
-    Log::info(TAG, "Product: " + product);
+    product_.assign(reinterpret_cast<char*>(buffer), len);
+    Log::info(TAG, "Product: " + product_);
     
     // Check for SystemLSI (Exynos)
-    if (product.find("SAMSUNG") != std::string::npos ||
-        product.find("LSI") != std::string::npos) {
+    if (product_.find("SAMSUNG") != std::string::npos ||
+        product_.find("LSI") != std::string::npos) {
         systemLSI_ = true;
     }
     
@@ -315,6 +315,10 @@ bool UsbDeviceImpl::isSupportedZLP() const {
     return supportedZLP_;
 }
 
+const std::string& UsbDeviceImpl::getProduct() const {
+    return product_;
+}
+
 int UsbDeviceImpl::write(const char* data, size_t size, unsigned int timeout) {
     if (!handle_ || !data || size == 0) {
         return -1;
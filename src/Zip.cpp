@@ -0,0 +1,392 @@
+/*
+ * Odin4 - Samsung Firmware Flashing Tool for Linux
+ * Zip - ZIP container reading implementation
+ */
+
+#include "Zip.h"
+#include "Log.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace Odin {
+
+const std::string Zip::TAG = "Zip";
+
+// Record signatures
+constexpr uint32_t ZIP_LOCAL_HEADER_SIG = 0x04034b50;
+constexpr uint32_t ZIP_CENTRAL_HEADER_SIG = 0x02014b50;
+constexpr uint32_t ZIP_EOCD_SIG = 0x06054b50;
+constexpr uint32_t ZIP64_EOCD_SIG = 0x06064b50;
+constexpr uint32_t ZIP64_LOCATOR_SIG = 0x07064b50;
+
+// Fixed record sizes
+constexpr size_t ZIP_LOCAL_HEADER_SIZE = 30;
+constexpr size_t ZIP_CENTRAL_HEADER_SIZE = 46;
+constexpr size_t ZIP_EOCD_SIZE = 22;
+constexpr size_t ZIP64_EOCD_SIZE = 56;
+constexpr size_t ZIP64_LOCATOR_SIZE = 20;
+constexpr size_t ZIP_MAX_COMMENT = 0xFFFF;
+
+constexpr uint16_t ZIP64_EXTRA_ID = 0x0001;
+constexpr uint16_t ZIP_FLAG_ENCRYPTED = 0x0001;
+
+static uint16_t readLE16(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint16_t>(u[0] | (u[1] << 8));
+}
+
+static uint32_t readLE32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(u[0]) | (static_cast<uint32_t>(u[1]) << 8) |
+           (static_cast<uint32_t>(u[2]) << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+static uint64_t readLE64(const char* p) {
+    return static_cast<uint64_t>(readLE32(p)) | (static_cast<uint64_t>(readLE32(p + 4)) << 32);
+}
+
+static bool preadFully(int fd, char* buffer, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t bytesRead = pread(fd, buffer, size, static_cast<off_t>(offset));
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            return false;
+        }
+        buffer += bytesRead;
+        offset += static_cast<uint64_t>(bytesRead);
+        size -= static_cast<size_t>(bytesRead);
+    }
+    return true;
+}
+
+Zip::Zip(const std::string& path)
+    : path_(path)
+    , fd_(-1)
+{
+}
+
+Zip::~Zip() {
+    close();
+}
+
+bool Zip::isZip(const char* header, size_t size) {
+    return size >= 4 && readLE32(header) == ZIP_LOCAL_HEADER_SIG;
+}
+
+bool Zip::open() {
+    if (fd_ >= 0) {
+        return true;
+    }
+    
+    fd_ = ::open(path_.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        Log::error(TAG, "Failed to open: " + path_);
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || static_cast<uint64_t>(st.st_size) < ZIP_EOCD_SIZE) {
+        Log::error(TAG, "Not a ZIP archive: " + path_);
+        close();
+        return false;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+    
+    // The end of central directory record sits in the last 22 bytes plus
+    // an optional comment of up to 64KB; scan backwards for it
+    size_t tailSize = static_cast<size_t>(std::min<uint64_t>(fileSize, ZIP_EOCD_SIZE + ZIP_MAX_COMMENT));
+    uint64_t tailStart = fileSize - tailSize;
+    std::vector<char> tail(tailSize);
+    
+    if (!readAt(tailStart, tail.data(), tailSize)) {
+        Log::error(TAG, "Failed to read ZIP trailer");
+        close();
+        return false;
+    }
+    
+    size_t eocdPos = std::string::npos;
+    for (size_t i = tailSize - ZIP_EOCD_SIZE + 1; i-- > 0;) {
+        if (readLE32(tail.data() + i) == ZIP_EOCD_SIG) {
+            eocdPos = i;
+            break;
+        }
+    }
+    
+    if (eocdPos == std::string::npos) {
+        Log::error(TAG, "End of central directory not found");
+        close();
+        return false;
+    }
+    
+    const char* eocd = tail.data() + eocdPos;
+    uint64_t count = readLE16(eocd + 10);
+    uint64_t cdSize = readLE32(eocd + 12);
+    uint64_t cdOffset = readLE32(eocd + 16);
+    
+    // ZIP64: sentinel values mean the real ones are in the ZIP64 record
+    if (count == 0xFFFF || cdSize == 0xFFFFFFFF || cdOffset == 0xFFFFFFFF) {
+        uint64_t eocdOffset = tailStart + eocdPos;
+        char locator[ZIP64_LOCATOR_SIZE];
+        char eocd64[ZIP64_EOCD_SIZE];
+        
+        if (eocdOffset < ZIP64_LOCATOR_SIZE ||
+            !readAt(eocdOffset - ZIP64_LOCATOR_SIZE, locator, sizeof(locator)) ||
+            readLE32(locator) != ZIP64_LOCATOR_SIG ||
+            !readAt(readLE64(locator + 8), eocd64, sizeof(eocd64)) ||
+            readLE32(eocd64) != ZIP64_EOCD_SIG) {
+            Log::error(TAG, "Invalid ZIP64 end of central directory");
+            close();
+            return false;
+        }
+        
+        count = readLE64(eocd64 + 32);
+        cdSize = readLE64(eocd64 + 40);
+        cdOffset = readLE64(eocd64 + 48);
+    }
+    
+    if (cdOffset > fileSize || cdSize > fileSize - cdOffset) {
+        Log::error(TAG, "Central directory outside archive");
+        close();
+        return false;
+    }
+    
+    if (!readCentralDirectory(cdOffset, cdSize, count)) {
+        close();
+        return false;
+    }
+    
+    Log::info(TAG, "Parsed " + std::to_string(members_.size()) + " members");
+    return true;
+}
+
+void Zip::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool Zip::readAt(uint64_t offset, char* buffer, size_t size) const {
+    return preadFully(fd_, buffer, size, offset);
+}
+
+bool Zip::readCentralDirectory(uint64_t offset, uint64_t size, uint64_t count) {
+    std::vector<char> directory(static_cast<size_t>(size));
+    if (!readAt(offset, directory.data(), directory.size())) {
+        Log::error(TAG, "Failed to read central directory");
+        return false;
+    }
+    
+    members_.clear();
+    members_.reserve(static_cast<size_t>(std::min<uint64_t>(count, size / ZIP_CENTRAL_HEADER_SIZE)));
+    
+    size_t pos = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        if (pos + ZIP_CENTRAL_HEADER_SIZE > directory.size() ||
+            readLE32(directory.data() + pos) != ZIP_CENTRAL_HEADER_SIG) {
+            Log::error(TAG, "Corrupt central directory entry " + std::to_string(i));
+            return false;
+        }
+        
+        const char* header = directory.data() + pos;
+        uint16_t nameLen = readLE16(header + 28);
+        uint16_t extraLen = readLE16(header + 30);
+        uint16_t commentLen = readLE16(header + 32);
+        
+        if (pos + ZIP_CENTRAL_HEADER_SIZE + nameLen + extraLen + commentLen > directory.size()) {
+            Log::error(TAG, "Truncated central directory entry " + std::to_string(i));
+            return false;
+        }
+        
+        ZipMember member;
+        member.flags = readLE16(header + 8);
+        member.method = readLE16(header + 10);
+        member.crc32 = readLE32(header + 16);
+        member.compressedSize = readLE32(header + 20);
+        member.uncompressedSize = readLE32(header + 24);
+        member.localHeaderOffset = readLE32(header + 42);
+        member.dataOffset = 0;
+        member.name.assign(header + ZIP_CENTRAL_HEADER_SIZE, nameLen);
+        
+        // ZIP64 extended information replaces saturated fields, in order
+        const char* extra = header + ZIP_CENTRAL_HEADER_SIZE + nameLen;
+        const char* extraEnd = extra + extraLen;
+        while (extra + 4 <= extraEnd) {
+            uint16_t id = readLE16(extra);
+            uint16_t length = readLE16(extra + 2);
+            const char* field = extra + 4;
+            const char* fieldEnd = std::min(field + length, extraEnd);
+            
+            if (id == ZIP64_EXTRA_ID) {
+                if (member.uncompressedSize == 0xFFFFFFFF && field + 8 <= fieldEnd) {
+                    member.uncompressedSize = readLE64(field);
+                    field += 8;
+                }
+                if (member.compressedSize == 0xFFFFFFFF && field + 8 <= fieldEnd) {
+                    member.compressedSize = readLE64(field);
+                    field += 8;
+                }
+                if (member.localHeaderOffset == 0xFFFFFFFF && field + 8 <= fieldEnd) {
+                    member.localHeaderOffset = readLE64(field);
+                }
+            }
+            
+            extra += 4 + length;
+        }
+        
+        pos += ZIP_CENTRAL_HEADER_SIZE + nameLen + extraLen + commentLen;
+        
+        // Directories carry no data
+        if (!member.name.empty() && member.name.back() == '/') {
+            continue;
+        }
+        
+        if (!resolveDataOffset(member)) {
+            Log::error(TAG, "Invalid local header: " + member.name);
+            return false;
+        }
+        
+        members_.push_back(member);
+    }
+    
+    return true;
+}
+
+bool Zip::resolveDataOffset(ZipMember& member) const {
+    // The local header's extra field may differ from the central one,
+    // so its length has to be read to find where the data starts
+    char local[ZIP_LOCAL_HEADER_SIZE];
+    if (!readAt(member.localHeaderOffset, local, sizeof(local)) ||
+        readLE32(local) != ZIP_LOCAL_HEADER_SIG) {
+        return false;
+    }
+    
+    member.dataOffset = member.localHeaderOffset + ZIP_LOCAL_HEADER_SIZE +
+                        readLE16(local + 26) + readLE16(local + 28);
+    return true;
+}
+
+const ZipMember* Zip::findMember(const std::string& name) const {
+    for (const auto& member : members_) {
+        if (member.name == name) {
+            return &member;
+        }
+    }
+    return nullptr;
+}
+
+std::unique_ptr<ZipMemberSource> ZipMemberSource::open(const std::string& path, const std::string& name,
+                                                       ReadMode mode, PageCache::Reader* cache) {
+    Zip zip(path);
+    if (!zip.open()) {
+        return nullptr;
+    }
+    
+    const ZipMember* member = zip.findMember(name);
+    if (!member) {
+        Log::error(Zip::TAG, "ZIP member not found: " + name);
+        return nullptr;
+    }
+    
+    return open(path, *member, mode, cache);
+}
+
+std::unique_ptr<ZipMemberSource> ZipMemberSource::open(const std::string& path, const ZipMember& member,
+                                                       ReadMode mode, PageCache::Reader* cache) {
+    if (member.flags & ZIP_FLAG_ENCRYPTED) {
+        Log::error(Zip::TAG, "Encrypted member not supported: " + member.name);
+        return nullptr;
+    }
+    
+    if (member.method != static_cast<uint16_t>(ZipMethod::Stored) &&
+        member.method != static_cast<uint16_t>(ZipMethod::Deflated)) {
+        Log::error(Zip::TAG, "Unsupported compression method " + std::to_string(member.method) +
+                   ": " + member.name);
+        return nullptr;
+    }
+    
+    std::unique_ptr<ByteSource> data = ByteSource::openFile(path, mode, member.dataOffset,
+                                                            member.compressedSize, cache);
+    if (!data) {
+        return nullptr;
+    }
+    
+    if (!member.isStored()) {
+        // Raw deflate stream (no zlib header)
+        std::unique_ptr<InflateSource> inflater(
+            new InflateSource(std::move(data), -MAX_WBITS, member.uncompressedSize));
+        if (!inflater->isValid()) {
+            return nullptr;
+        }
+        data = std::move(inflater);
+    }
+    
+    return std::unique_ptr<ZipMemberSource>(new ZipMemberSource(member, std::move(data)));
+}
+
+ZipMemberSource::ZipMemberSource(const ZipMember& member, std::unique_ptr<ByteSource> data)
+    : member_(member)
+    , data_(std::move(data))
+    , position_(0)
+    , crc_(static_cast<uint32_t>(crc32(0L, Z_NULL, 0)))
+    , crcTracked_(true)
+{
+}
+
+ssize_t ZipMemberSource::read(char* buffer, size_t size) {
+    // zlib counts in uInt, so the CRC update limits a single read
+    uint64_t remaining = member_.uncompressedSize - position_;
+    size = static_cast<size_t>(std::min<uint64_t>(std::min<uint64_t>(size, remaining), 0x40000000));
+    if (size == 0) {
+        return 0;
+    }
+    
+    ssize_t bytesRead = data_->read(buffer, size);
+    if (bytesRead < 0) {
+        return -1;
+    }
+    if (bytesRead == 0) {
+        Log::error(Zip::TAG, "Truncated member: " + member_.name);
+        return -1;
+    }
+    
+    if (crcTracked_) {
+        crc_ = static_cast<uint32_t>(crc32(crc_, reinterpret_cast<const Bytef*>(buffer),
+                                           static_cast<uInt>(bytesRead)));
+    }
+    
+    position_ += static_cast<uint64_t>(bytesRead);
+    
+    if (position_ == member_.uncompressedSize && crcTracked_ && crc_ != member_.crc32) {
+        Log::error(Zip::TAG, "CRC mismatch: " + member_.name);
+        return -1;
+    }
+    
+    return bytesRead;
+}
+
+bool ZipMemberSource::skip(uint64_t bytes) {
+    if (bytes > member_.uncompressedSize - position_) {
+        return false;
+    }
+    
+    if (!member_.isStored()) {
+        // Deflate has no random access; decode and discard
+        return ByteSource::skip(bytes);
+    }
+    
+    if (!data_->skip(bytes)) {
+        return false;
+    }
+    position_ += bytes;
+    crcTracked_ = false;
+    return true;
+}
+
+} // namespace Odin
@@ -7,16 +7,29 @@
  */
 
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <fcntl.h>
 #include <unistd.h>
 
+#include "ByteSource.h"
+#include "DigestCache.h"
+#include "PitCache.h"
 #include "DownloadEngine.h"
 #include "FirmwareData.h"
+#include "FirmwareImage.h"
+#include "MemoryBudget.h"
+#include "PageCache.h"
+#include "Sha256Engine.h"
+#include "Tar.h"
 #include "UsbDevice.h"
 #include "Log.h"
 #include "OdinException.h"
@@ -44,6 +57,7 @@ void printUsage() {
               << "  -h                  Show this help message\n"
               << "  -v                  Show version\n"
               << "  -w                  Show licenses\n"
+              << "  --benchmark <file>  Time TAR indexing and each read mode on a file (diagnostic)\n"
               << "\n"
               << "Firmware Options:\n"
               << "  -b <file>           Add Bootloader (BL)\n"
@@ -58,6 +72,16 @@ void printUsage() {
               << "  -e                  Erase NAND before flashing\n"
               << "  --reboot            Reboot to normal mode after flashing\n"
               << "  --redownload        Reboot to download mode (if supported)\n"
+              << "  --no-index-cache    Always reparse firmware (place before file options)\n"
+              << "  --no-digest-cache   Always rehash firmware archives (place before file options)\n"
+              << "  --no-pit-cache      Parse every device PIT separately\n"
+              << "  --write-tar-index   Write a .odinidx sidecar next to each TAR (place before file options)\n"
+              << "  --write-chunk-manifest  Write a .chunks manifest next to each TAR (place before file options)\n"
+              << "  --verify-chunks     Check TAR entries against their .chunks manifest up front (place before file options)\n"
+              << "  --mem-limit <MB>    Cap firmware buffer memory across all devices\n"
+              << "  --read-mode <mode>  Firmware reads: buffered (default), mmap, uring or direct\n"
+              << "  --report <file>     Write what was sent to each device, with digests (TSV)\n"
+              << "  --keep-page-cache   Leave firmware in the page cache after flashing\n"
               << "\n"
               << "----------------------------------------\n"
               << "Device Setup (Linux):\n"
@@ -73,6 +97,9 @@ void printUsage() {
               << "  # List and select specific device:\n"
               << "  odin4 -l\n"
               << "  odin4 -b BL.tar -a AP.tar -d /dev/bus/usb/001/004\n"
+              << "\n"
+              << "  # Flash a TAR piped on standard input:\n"
+              << "  zstd -dc AP.tar.zst | odin4 -a -\n"
               << "\n";
 }
 
@@ -88,19 +115,187 @@ std::vector<std::string> listDevices() {
     return paths;
 }
 
+void reportMemoryPeak() {
+    const MemoryBudget& budget = MemoryBudget::instance();
+    std::string message = "Peak firmware memory: " + std::to_string(budget.getPeak() >> 20) + " MB";
+    if (budget.getLimit() != 0) {
+        message += " (limit " + std::to_string(budget.getLimit() >> 20) + " MB)";
+    }
+    Log::info("main", message);
+}
+
+struct DeviceReport {
+    std::string devicePath;
+    std::string model;          // From the device info, empty if not reported
+    bool success;
+    std::vector<TransferRecord> transfers;
+};
+
+// Tab-separated, one line per payload sent: what each device received
+// and whether it matched the digest recorded for it
+bool writeRunReport(const std::string& path, const std::vector<DeviceReport>& reports) {
+    std::ofstream out(path);
+    if (!out) {
+        Log::error("main", "Cannot write run report: " + path);
+        return false;
+    }
+    
+    out << "device\tmodel\tresult\tfile\tbytes\tsha256\tcheck\tseconds\n";
+    for (const auto& report : reports) {
+        for (const auto& transfer : report.transfers) {
+            const char* check = "unchecked";
+            if (!transfer.expected.empty()) {
+                check = transfer.sha256 == transfer.expected ? "verified" : "MISMATCH";
+            }
+            out << report.devicePath << '\t'
+                << (report.model.empty() ? "-" : report.model) << '\t'
+                << (report.success ? "ok" : "failed") << '\t'
+                << transfer.filename << '\t'
+                << transfer.bytes << '\t'
+                << transfer.sha256 << '\t'
+                << check << '\t'
+                << transfer.seconds << '\n';
+        }
+    }
+    
+    if (!out.flush()) {
+        Log::error("main", "Cannot write run report: " + path);
+        return false;
+    }
+    Log::info("main", "Run report written to " + path);
+    return true;
+}
+
+// Diagnostic timings for a firmware file, no device needed: TAR
+// indexing (the first pass shows cold-cache cost if the file was not
+// read recently), sequential read throughput of every read mode and the
+// speed of each SHA-256 kernel the CPU supports.
+int runBenchmark(const std::string& path) {
+    constexpr int TAR_INDEX_PASSES = 5;
+    constexpr size_t BENCHMARK_READ_SIZE = 0x1000000;  // 16MB, one transfer window
+    constexpr size_t BENCHMARK_HASH_SIZE = 0x4000000;  // 64MB
+    
+    for (int pass = 0; pass < TAR_INDEX_PASSES; pass++) {
+        Tar tar(path);
+        auto start = std::chrono::steady_clock::now();
+        if (!tar.open()) {
+            return 1;
+        }
+        auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        
+        size_t count = tar.getEntries().size();
+        std::cout << "TAR index pass " << (pass + 1) << ": " << count << " entries in "
+                  << static_cast<long>(elapsed) << " us";
+        if (count > 0) {
+            std::cout << " (" << elapsed / count << " us/entry";
+            std::cout << (tar.isIndexed() ? ", from sidecar)" : ")");
+        }
+        std::cout << std::endl;
+    }
+    
+    // Read the whole file once per mode, first with none of it cached
+    // (as on a station flashing a package it has not read yet), then
+    // again with whatever the mode left in the page cache
+    struct { ReadMode mode; const char* name; } modes[] = {
+        { ReadMode::Buffered, "buffered" },
+        { ReadMode::Mmap, "mmap" },
+        { ReadMode::Uring, "uring" },
+        { ReadMode::Direct, "direct" },
+    };
+    std::vector<char> buffer(BENCHMARK_READ_SIZE);
+    
+    for (const auto& mode : modes) {
+        std::cout << "Read " << mode.name << ":";
+        
+        for (int pass = 0; pass < 2; pass++) {
+            if (pass == 0) {
+                int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd >= 0) {
+                    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                    close(fd);
+                }
+            }
+            
+            auto start = std::chrono::steady_clock::now();
+            std::unique_ptr<ByteSource> source = ByteSource::openFile(path, mode.mode);
+            if (!source) {
+                return 1;
+            }
+            
+            uint64_t total = 0;
+            ssize_t bytesRead;
+            while ((bytesRead = source->read(buffer.data(), buffer.size())) > 0) {
+                total += static_cast<uint64_t>(bytesRead);
+            }
+            if (bytesRead < 0) {
+                return 1;
+            }
+            source.reset();
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            
+            std::cout << (pass == 0 ? " cold " : ", warm ")
+                      << static_cast<long>(total / 1048576.0 / std::max(elapsed, 1e-9)) << " MB/s";
+        }
+        std::cout << std::endl;
+    }
+    
+    // SHA-256 kernels this CPU has: one stream, then as many streams as
+    // the kernel interleaves
+    std::vector<unsigned char> data(BENCHMARK_HASH_SIZE);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<unsigned char>(i * 131);
+    }
+    
+    Sha256Kernel selected = Sha256Engine::getKernel();
+    Sha256Kernel kernels[] = { Sha256Kernel::Portable, Sha256Kernel::ShaNi, Sha256Kernel::ArmV8, Sha256Kernel::Avx2 };
+    
+    for (Sha256Kernel kernel : kernels) {
+        if (!Sha256Engine::setKernel(kernel)) {
+            continue;
+        }
+        
+        unsigned char digest[SHA256_DIGEST_SIZE];
+        auto start = std::chrono::steady_clock::now();
+        Sha256Engine::digest(data.data(), data.size(), digest);
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        std::cout << "SHA-256 " << Sha256Engine::kernelName(kernel) << ": "
+                  << static_cast<long>(data.size() / 1048576.0 / std::max(elapsed, 1e-9)) << " MB/s";
+        
+        size_t lanes = Sha256Engine::getLanes();
+        if (lanes > 1) {
+            std::vector<const unsigned char*> inputs(lanes, data.data());
+            std::vector<size_t> sizes(lanes, data.size());
+            std::unique_ptr<unsigned char[][SHA256_DIGEST_SIZE]> digests(new unsigned char[lanes][SHA256_DIGEST_SIZE]);
+            
+            start = std::chrono::steady_clock::now();
+            Sha256Engine::digestMany(inputs.data(), sizes.data(), lanes, digests.get());
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            
+            std::cout << ", " << lanes << " streams "
+                      << static_cast<long>(lanes * data.size() / 1048576.0 / std::max(elapsed, 1e-9)) << " MB/s";
+        }
+        std::cout << (kernel == selected ? " (selected)" : "") << std::endl;
+    }
+    Sha256Engine::setKernel(selected);
+    
+    return 0;
+}
+
 struct ThreadResult {
     bool success;
     std::string devicePath;
 };
 
 void downloadThread(const std::string& devicePath, 
-                    FirmwareData firmware,
+                    std::shared_ptr<const FirmwareImage> firmware,
                     bool redownload,
                     std::atomic<int>& successCount,
+                    std::vector<DeviceReport>& reports,
                     std::mutex& mutex) {
     Log::setDevicePrefix(devicePath);
     
-    DownloadEngine engine(devicePath, &firmware);
+    DownloadEngine engine(devicePath, std::move(firmware));
     
     bool result;
     if (redownload) {
@@ -109,10 +304,11 @@ void downloadThread(const std::string& devicePath,
         result = engine.download();
     }
     
+    std::lock_guard<std::mutex> lock(mutex);
     if (result) {
-        std::lock_guard<std::mutex> lock(mutex);
         successCount++;
     }
+    reports.push_back(DeviceReport{devicePath, engine.getProfile().model, result, engine.getTransfers()});
 }
 
 int main(int argc, char** argv) {
@@ -120,7 +316,7 @@ int main(int argc, char** argv) {
         std::cout << "Usage: odin4 -h" << std::endl;
         return 1;
     }
-
+    
     // Development Warning
     std::cerr << "WARNING: This tool is for EDUCATIONAL PURPOSES ONLY and is NOT FULLY TESTED.\n"
               << "Use at your own risk. Incorrect usage may BRICK your device.\n"
@@ -130,6 +326,7 @@ int main(int argc, char** argv) {
     std::vector<std::string> devicePaths;
     FirmwareData firmware;
     bool redownload = false;
+    std::string reportPath;
     
     // Check if stdin is a terminal
     bool isInteractive = isatty(fileno(stdin)) != 0;
@@ -159,6 +356,10 @@ int main(int argc, char** argv) {
             return 0;
         }
         
+        if (arg == "--benchmark" && i + 1 < argc) {
+            return runBenchmark(argv[++i]);
+        }
+        
         if (arg == "-b" && i + 1 < argc) {
             if (!firmware.setBootloader(argv[++i])) {
                 return 1;
@@ -206,6 +407,73 @@ int main(int argc, char** argv) {
             continue;
         }
         
+        if (arg == "--no-index-cache") {
+            firmware.setIndexCache(false);
+            continue;
+        }
+        
+        if (arg == "--no-digest-cache") {
+            DigestCache::instance().setEnabled(false);
+            continue;
+        }
+        
+        if (arg == "--no-pit-cache") {
+            PitCache::instance().setEnabled(false);
+            continue;
+        }
+        
+        if (arg == "--write-chunk-manifest") {
+            firmware.setChunkManifestWrite(true);
+            continue;
+        }
+        
+        if (arg == "--verify-chunks") {
+            firmware.setChunkVerify(true);
+            continue;
+        }
+        
+        if (arg == "--write-tar-index") {
+            firmware.setTarIndexWrite(true);
+            continue;
+        }
+        
+        if (arg == "--mem-limit" && i + 1 < argc) {
+            long limitMB = strtol(argv[++i], nullptr, 10);
+            if (limitMB <= 0) {
+                std::cout << "odin4: invalid memory limit " << argv[i] << std::endl;
+                return 1;
+            }
+            MemoryBudget::instance().setLimit(static_cast<size_t>(limitMB) << 20);
+            continue;
+        }
+        
+        if (arg == "--report" && i + 1 < argc) {
+            reportPath = argv[++i];
+            continue;
+        }
+        
+        if (arg == "--keep-page-cache") {
+            PageCache::instance().setDropBehind(false);
+            continue;
+        }
+        
+        if (arg == "--read-mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "buffered") {
+                firmware.setReadMode(ReadMode::Buffered);
+            } else if (mode == "mmap") {
+                firmware.setReadMode(ReadMode::Mmap);
+            } else if (mode == "uring") {
+                firmware.setReadMode(ReadMode::Uring);
+            } else if (mode == "direct") {
+                firmware.setReadMode(ReadMode::Direct);
+            } else {
+                std::cout << "odin4: unknown read mode " << mode << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        
         if (arg == "-d" && i + 1 < argc) {
             devicePaths.push_back(argv[++i]);
             continue;
@@ -228,6 +496,26 @@ int main(int argc, char** argv) {
         return 1;
     }
     
+    // Archive digests were computed in the background while parsing
+    if (!firmware.awaitVerification()) {
+        return 1;
+    }
+    
+    // Parsing is done; every device shares this snapshot
+    std::shared_ptr<const FirmwareImage> image = firmware.createImage();
+    
+    // With a supplied PIT, report unmapped files before touching any device
+    if (image->hasPIT()) {
+        std::vector<PITView::Entry> targets;
+        std::vector<std::string> unmapped;
+        if (!image->mapPartitions(image->getPIT(), targets, unmapped)) {
+            for (const auto& filename : unmapped) {
+                Log::error("main", "No PIT entry for: " + filename);
+            }
+            return 1;
+        }
+    }
+    
     // Auto-detect devices if none specified
     if (devicePaths.empty()) {
         auto devices = UsbDevice::listDevices();
@@ -241,11 +529,17 @@ int main(int argc, char** argv) {
         }
     }
     
+    // Standard input is consumed once, by one device
+    if (image->hasStreamInput() && devicePaths.size() > 1) {
+        Log::error("main", "standard input can only be flashed to one device");
+        return 1;
+    }
+    
     // Single device mode
     if (devicePaths.size() == 1) {
         Log::info("main", "Starting download on: " + devicePaths[0]);
         
-        DownloadEngine engine(devicePaths[0], &firmware);
+        DownloadEngine engine(devicePaths[0], image);
         
         bool result;
         if (redownload) {
@@ -254,6 +548,11 @@ int main(int argc, char** argv) {
             result = engine.download();
         }
         
+        reportMemoryPeak();
+        if (!reportPath.empty()) {
+            writeRunReport(reportPath, {DeviceReport{devicePaths[0], engine.getProfile().model, result,
+                                                      engine.getTransfers()}});
+        }
         return result ? 0 : 1;
     }
     
@@ -263,11 +562,12 @@ int main(int argc, char** argv) {
     
     std::vector<std::thread> threads;
     std::atomic<int> successCount(0);
+    std::vector<DeviceReport> reports;
     std::mutex mutex;
     
     for (const auto& path : devicePaths) {
-        threads.emplace_back(downloadThread, path, firmware, redownload,
-                            std::ref(successCount), std::ref(mutex));
+        threads.emplace_back(downloadThread, path, image, redownload,
+                            std::ref(successCount), std::ref(reports), std::ref(mutex));
     }
     
     // Wait for all threads
@@ -282,6 +582,10 @@ int main(int argc, char** argv) {
     
     Log::info("main", "All threads completed. (succeed " + std::to_string(successCount.load()) + 
               " / failed " + std::to_string(failed) + ")");
+    reportMemoryPeak();
+    if (!reportPath.empty()) {
+        writeRunReport(reportPath, reports);
+    }
     
     return (successCount.load() == total) ? 0 : 1;
 }